@@ -0,0 +1,783 @@
+/********************************************************************************************************************************************************************************************
+* FileName   : WebPBenchmark.cpp
+* Description: Google Benchmark suite for WebpEncoder, WebpDecoder, WebpAnimationEncoder and the image_io readers
+* Date		 : 17/10/2026
+* Author     : Ramesh Kumar K
+*
+********************************************************************************************************************************************************************************************/
+
+# include "WebPBenchmarkCorpus.h"
+# include "WebPencoder.h"
+# include "WebPDecoder.h"
+# include "WebPAnimationEncoder.h"
+# include <algorithm>
+# include <atomic>
+# include <chrono>
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <vector>
+
+# include <benchmark/benchmark.h>
+
+# include "webp/decode.h"
+# include "webp/encode.h"
+# include "imageio/imageio_util.h"
+# include "imageio/jpegdec.h"
+# include "imageio/pngdec.h"
+# include "imageio/pnmdec.h"
+# include "imageio/tiffdec.h"
+# include "imageio/webpdec.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Allocation counting. On glibc the malloc family is interposed for the whole process, so libwebp's own allocations are counted along with
+// ours and the standard library's; elsewhere the counter stays at zero.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<uint64_t>											g_allocations(0);
+
+#if defined(WEBP_BENCHMARK_COUNT_ALLOCATIONS) && defined(__GLIBC__)
+
+extern "C"
+{
+	void*	__libc_malloc	( size_t n_size );
+	void*	__libc_calloc	( size_t n_count, size_t n_size );
+	void*	__libc_realloc	( void* p, size_t n_size );
+	void	__libc_free		( void* p );
+
+	void* malloc( size_t n_size )
+	{
+		g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+		return __libc_malloc(n_size);
+	}
+
+	void* calloc( size_t n_count, size_t n_size )
+	{
+		g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+		return __libc_calloc(n_count, n_size);
+	}
+
+	void* realloc( void* p, size_t n_size )
+	{
+		g_allocations.fetch_add(1, std::memory_order_relaxed);		// a resize costs about as much as a new block
+
+		return __libc_realloc(p, n_size);
+	}
+
+	void free( void* p )
+	{
+		__libc_free(p);
+	}
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Per-iteration latencies for p50/p99 plus the throughput and allocation counters every benchmark reports
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class WebpBenchmarkRecorder
+{
+
+public:
+
+	explicit WebpBenchmarkRecorder( benchmark::State &state ) : m_state(state)
+	{
+		m_samples.reserve((size_t)state.max_iterations < kMaxSamples ? (size_t)state.max_iterations : kMaxSamples);		// no allocation inside the timed loop
+
+		n_start_allocations = g_allocations.load(std::memory_order_relaxed);
+	}
+
+	void Start( )
+	{
+		m_start = std::chrono::steady_clock::now();
+	}
+
+	void Stop( )
+	{
+		if (m_samples.size() < m_samples.capacity())
+		{
+			m_samples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count());
+		}
+	}
+
+	/*
+	* n_pixels and n_bytes are per operation: the raw pixels for encodes, the file for decodes and reads
+	*/
+	void Report( double n_pixels, double n_bytes )
+	{
+		const uint64_t n_allocations = g_allocations.load(std::memory_order_relaxed) - n_start_allocations;
+
+		m_state.SetBytesProcessed((int64_t)(n_bytes * m_state.iterations()));
+
+		m_state.counters["Mpx"]			= benchmark::Counter(n_pixels * m_state.iterations() / 1e6, benchmark::Counter::kIsRate);
+		m_state.counters["allocs/op"]	= benchmark::Counter((double)n_allocations, benchmark::Counter::kAvgIterations);
+
+		if (!m_samples.empty())
+		{
+			std::sort(m_samples.begin(), m_samples.end());
+
+			m_state.counters["p50_ms"]	= m_samples[(m_samples.size() - 1) / 2];
+			m_state.counters["p99_ms"]	= m_samples[(m_samples.size() - 1) * 99 / 100];
+		}
+	}
+
+private:
+
+	static const size_t													kMaxSamples = 1 << 16;
+
+	benchmark::State&													m_state;
+
+	std::vector<double>													m_samples;
+
+	std::chrono::steady_clock::time_point								m_start;
+
+	uint64_t															n_start_allocations;
+
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Benchmarks
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+* WebpEncoder::EncodeImage of an RGBA image, arguments: size, quality, method, lossless
+*/
+static void BM_EncodeImage( benchmark::State &state )
+{
+	const int							n_size		= (int)state.range(0);
+	const bool							b_lossless	= state.range(3) != 0;
+
+	const std::vector<uint8_t>			&pixels		= WebpBenchmarkGetPixels(n_size, b_lossless ? WEBP_BENCHMARK_CONTENT_GRAPHIC : WEBP_BENCHMARK_CONTENT_PHOTO);
+
+	ImageCompressionProperties			properties;
+
+	properties.pixel_format						= PIXEL_FORMAT_RGBA;
+	properties.b_retain_alpha					= true;
+	properties.f_quality_factor					= (float)state.range(1);
+	properties.n_speed							= (int)state.range(2);
+	properties.b_use_lossless_image_compression	= b_lossless;
+
+	WebpEncoder							encoder;
+
+	if (!encoder.InitEncoder(properties))
+	{
+		state.SkipWithError("InitEncoder failed");
+		return;
+	}
+
+	std::vector<char>					out_img;
+
+	size_t								output_size = 0;
+
+	WebpBenchmarkRecorder				recorder(state);
+
+	for (auto _ : state)
+	{
+		recorder.Start();
+
+		if (!encoder.EncodeImageWithStride(&pixels[0], n_size, n_size, 4, n_size * 4, out_img, output_size))
+		{
+			state.SkipWithError("EncodeImage failed");
+			break;
+		}
+
+		recorder.Stop();
+	}
+
+	recorder.Report((double)n_size * n_size, (double)pixels.size());
+
+	state.counters["bpp"] = output_size * 8.0 / ((double)n_size * n_size);
+}
+
+BENCHMARK(BM_EncodeImage)
+	->ArgNames({ "size", "quality", "method", "lossless" })
+	->ArgsProduct({ { 256, 1024, 2048 }, { 50, 75, 95 }, { 0, 4, 6 }, { 0, 1 } })
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+
+/*
+* WebpDecoder::DecodeImage of a lossy file, arguments: size, bytes per output pixel (3 = RGB, 4 = RGBA)
+*/
+static void BM_DecodeImage( benchmark::State &state )
+{
+	const int							n_size	= (int)state.range(0);
+	const int							n_bpp	= (int)state.range(1);
+
+	const std::vector<uint8_t>			&file	= WebpBenchmarkGetFile(n_size, WEBP_BENCHMARK_FORMAT_WEBP);
+
+	if (file.empty())
+	{
+		state.SkipWithError("no WebP corpus file");
+		return;
+	}
+
+	WebpDecoder							decoder;
+
+	decoder.SetOutPutPixelFormat(n_bpp == 3 ? PIXEL_FORMAT_RGB : PIXEL_FORMAT_RGBA);
+	decoder.InitDecoder();
+
+	WebpBenchmarkRecorder				recorder(state);
+
+	for (auto _ : state)
+	{
+		int								width = 0;
+		int								height = 0;
+
+		uint8_t							*out_image = NULL;
+
+		recorder.Start();
+
+		if (!decoder.DecodeImage(&file[0], file.size(), width, height, &out_image) || !out_image)
+		{
+			state.SkipWithError("DecodeImage failed");
+			break;
+		}
+
+		recorder.Stop();
+
+		WebpDecoder::FreeImage(out_image);
+	}
+
+	recorder.Report((double)n_size * n_size, (double)file.size());
+}
+
+BENCHMARK(BM_DecodeImage)
+	->ArgNames({ "size", "bpp" })
+	->ArgsProduct({ { 256, 1024, 2048 }, { 3, 4 } })
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+
+/*
+* WebpDecoder::DecodeInto a buffer allocated once before the loop, arguments: size, bytes per output pixel
+*/
+static void BM_DecodeInto( benchmark::State &state )
+{
+	const int							n_size	= (int)state.range(0);
+	const int							n_bpp	= (int)state.range(1);
+
+	const std::vector<uint8_t>			&file	= WebpBenchmarkGetFile(n_size, WEBP_BENCHMARK_FORMAT_WEBP);
+
+	if (file.empty())
+	{
+		state.SkipWithError("no WebP corpus file");
+		return;
+	}
+
+	WebpDecoder							decoder;
+
+	decoder.SetOutPutPixelFormat(n_bpp == 3 ? PIXEL_FORMAT_RGB : PIXEL_FORMAT_RGBA);
+	decoder.InitDecoder();
+
+	std::vector<uint8_t>				out_image((size_t)n_size * n_size * n_bpp);
+
+	WebpBenchmarkRecorder				recorder(state);
+
+	for (auto _ : state)
+	{
+		int								width = 0;
+		int								height = 0;
+
+		recorder.Start();
+
+		if (!decoder.DecodeInto(&file[0], file.size(), &out_image[0], out_image.size(), n_size * n_bpp, width, height))
+		{
+			state.SkipWithError("DecodeInto failed");
+			break;
+		}
+
+		recorder.Stop();
+	}
+
+	recorder.Report((double)n_size * n_size, (double)file.size());
+}
+
+BENCHMARK(BM_DecodeInto)
+	->ArgNames({ "size", "bpp" })
+	->ArgsProduct({ { 256, 1024, 2048 }, { 3, 4 } })
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+
+/*
+* WebpDecoder::DecodeImage scaled inside libwebp to a thumbnail, arguments: size, thumbnail width (the height keeps the aspect ratio)
+*/
+static void BM_DecodeThumbnail( benchmark::State &state )
+{
+	const int							n_size	= (int)state.range(0);
+
+	const std::vector<uint8_t>			&file	= WebpBenchmarkGetFile(n_size, WEBP_BENCHMARK_FORMAT_WEBP);
+
+	if (file.empty())
+	{
+		state.SkipWithError("no WebP corpus file");
+		return;
+	}
+
+	WebpDecodeOptions					options;
+
+	options.b_use_scaling				= true;
+	options.n_scaled_width				= (int)state.range(1);
+
+	WebpDecoder							decoder;
+
+	decoder.SetOutPutPixelFormat(PIXEL_FORMAT_RGBA);
+	decoder.InitDecoder();
+
+	if (!decoder.SetDecodeOptions(options))
+	{
+		state.SkipWithError("SetDecodeOptions failed");
+		return;
+	}
+
+	WebpBenchmarkRecorder				recorder(state);
+
+	for (auto _ : state)
+	{
+		int								width = 0;
+		int								height = 0;
+
+		uint8_t							*out_image = NULL;
+
+		recorder.Start();
+
+		if (!decoder.DecodeImage(&file[0], file.size(), width, height, &out_image) || !out_image)
+		{
+			state.SkipWithError("DecodeImage failed");
+			break;
+		}
+
+		recorder.Stop();
+
+		WebpDecoder::FreeImage(out_image);
+	}
+
+	recorder.Report((double)n_size * n_size, (double)file.size());
+}
+
+BENCHMARK(BM_DecodeThumbnail)
+	->ArgNames({ "size", "thumb" })
+	->ArgsProduct({ { 1024, 2048 }, { 128, 256 } })
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+
+/*
+* WebpDecoder::DecodeImage with the latency options of WebpDecodeOptions, arguments: size, threads, fast (bypass filtering and pointwise
+* upsampling)
+*/
+static void BM_DecodeOptions( benchmark::State &state )
+{
+	const int							n_size	= (int)state.range(0);
+
+	const std::vector<uint8_t>			&file	= WebpBenchmarkGetFile(n_size, WEBP_BENCHMARK_FORMAT_WEBP);
+
+	if (file.empty())
+	{
+		state.SkipWithError("no WebP corpus file");
+		return;
+	}
+
+	WebpDecodeOptions					options;
+
+	options.b_use_threads				= state.range(1) != 0;
+	options.b_bypass_filtering			= state.range(2) != 0;
+	options.b_no_fancy_upsampling		= state.range(2) != 0;
+
+	WebpDecoder							decoder;
+
+	decoder.SetOutPutPixelFormat(PIXEL_FORMAT_RGBA);
+	decoder.InitDecoder();
+	decoder.SetDecodeOptions(options);
+
+	WebpBenchmarkRecorder				recorder(state);
+
+	for (auto _ : state)
+	{
+		int								width = 0;
+		int								height = 0;
+
+		uint8_t							*out_image = NULL;
+
+		recorder.Start();
+
+		if (!decoder.DecodeImage(&file[0], file.size(), width, height, &out_image) || !out_image)
+		{
+			state.SkipWithError("DecodeImage failed");
+			break;
+		}
+
+		recorder.Stop();
+
+		WebpDecoder::FreeImage(out_image);
+	}
+
+	recorder.Report((double)n_size * n_size, (double)file.size());
+}
+
+BENCHMARK(BM_DecodeOptions)
+	->ArgNames({ "size", "threads", "fast" })
+	->ArgsProduct({ { 1024, 2048 }, { 0, 1 }, { 0, 1 } })
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+
+/*
+* WebpAnimationEncoder on 16 frames of a window scrolling over a photo, arguments: size, pipelined, allow mixed
+*/
+static void BM_EncodeAnimation( benchmark::State &state )
+{
+	const int							n_size		= (int)state.range(0);
+	const int							n_frames	= 16;
+	const int							n_step		= 8;		// pixels the window moves per frame
+
+	const std::vector<uint8_t>			&pixels		= WebpBenchmarkGetPixels(2 * n_size, WEBP_BENCHMARK_CONTENT_PHOTO);
+
+	ImageCompressionProperties			properties;
+	WebpAnimationEncodeOptions			anim_options;
+
+	properties.pixel_format				= PIXEL_FORMAT_RGBA;
+	properties.b_retain_alpha			= true;
+	properties.n_speed					= 4;
+
+	anim_options.b_pipelined			= state.range(1) != 0;
+	anim_options.b_allow_mixed			= state.range(2) != 0;
+
+	WebpAnimationEncoder				encoder;
+
+	if (!encoder.InitEncoder(properties, anim_options))
+	{
+		state.SkipWithError("InitEncoder failed");
+		return;
+	}
+
+	std::vector<char>					out_img;
+
+	size_t								output_size = 0;
+
+	WebpBenchmarkRecorder				recorder(state);
+
+	for (auto _ : state)
+	{
+		recorder.Start();
+
+		bool							b_ok = encoder.Begin(n_size, n_size);
+
+		for (int i = 0; i < n_frames && b_ok; ++i)
+		{
+			b_ok = encoder.AddFrame(&pixels[((size_t)i * n_step * 2 * n_size + (size_t)i * n_step) * 4], i * 40, 2 * n_size * 4);
+		}
+
+		if (!b_ok || !encoder.Finish(n_frames * 40, out_img, output_size))
+		{
+			state.SkipWithError("animation encode failed");
+			break;
+		}
+
+		recorder.Stop();
+	}
+
+	recorder.Report((double)n_size * n_size * n_frames, (double)n_size * n_size * 4 * n_frames);
+
+	state.counters["bpp"] = output_size * 8.0 / ((double)n_size * n_size * n_frames);
+}
+
+BENCHMARK(BM_EncodeAnimation)
+	->ArgNames({ "size", "pipelined", "mixed" })
+	->ArgsProduct({ { 256, 512 }, { 0, 1 }, { 0, 1 } })
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+
+/*
+* WebpEncoder::EncodeBatch of 16 YUVA420 frames with alpha retained, arguments: size, threads. The left quarter of every frame is transparent,
+* so the encoder has to copy the planes before libwebp cleans them up; every item is checked against a single image EncodeYUV of its frame
+* and the frames must come back untouched, which catches workers sharing the copy.
+*/
+static void BM_EncodeBatchYUVA( benchmark::State &state )
+{
+	const int							n_size		= (int)state.range(0);
+	const int							n_items		= 16;
+	const int							n_uv_size	= (n_size + 1) >> 1;
+	const size_t						y_size		= (size_t)n_size * n_size;
+	const size_t						uv_size		= (size_t)n_uv_size * n_uv_size;
+
+	const std::vector<uint8_t>			&pixels		= WebpBenchmarkGetPixels(2 * n_size, WEBP_BENCHMARK_CONTENT_PHOTO);
+
+	ImageCompressionProperties			properties;
+
+	properties.pixel_format				= PIXEL_FORMAT_YUVA420;
+	properties.b_retain_alpha			= true;
+	properties.n_speed					= 4;
+	properties.n_thread_count			= (unsigned int)state.range(1);
+
+	WebpEncoder							encoder;
+
+	if (!encoder.SetPixelFormat(PIXEL_FORMAT_YUVA420) || !encoder.InitEncoder(properties))
+	{
+		state.SkipWithError("InitEncoder failed");
+		return;
+	}
+
+	std::vector<std::vector<uint8_t> >	frames(n_items);
+	std::vector<std::vector<char> >		expected(n_items);
+	std::vector<WebpBatchInput>			inputs(n_items);
+	std::vector<WebpBatchOutput>		outputs(n_items);
+
+	for (int i = 0; i < n_items; ++i)
+	{
+		WebPPicture						picture;
+		WebpYUVPlanes					planes;
+		size_t							output_size = 0;
+
+		WebPPictureInit(&picture);
+
+		picture.width					= n_size;
+		picture.height					= n_size;
+
+		if (!WebPPictureImportRGBA(&picture, &pixels[(size_t)i * 8 * 2 * n_size * 4 + (size_t)i * 8 * 4], 2 * n_size * 4))
+		{
+			state.SkipWithError("cannot convert the frames");
+			return;
+		}
+
+		std::vector<uint8_t>			&frame = frames[i];
+
+		frame.resize(2 * y_size + 2 * uv_size);
+
+		for (int y = 0; y < n_size; ++y)
+		{
+			memcpy(&frame[(size_t)y * n_size], picture.y + (size_t)y * picture.y_stride, n_size);
+			memset(&frame[y_size + 2 * uv_size + (size_t)y * n_size], 0, n_size / 4);
+			memset(&frame[y_size + 2 * uv_size + (size_t)y * n_size + n_size / 4], 0xff, n_size - n_size / 4);
+		}
+
+		for (int y = 0; y < n_uv_size; ++y)
+		{
+			memcpy(&frame[y_size + (size_t)y * n_uv_size], picture.u + (size_t)y * picture.uv_stride, n_uv_size);
+			memcpy(&frame[y_size + uv_size + (size_t)y * n_uv_size], picture.v + (size_t)y * picture.uv_stride, n_uv_size);
+		}
+
+		WebPPictureFree(&picture);
+
+		planes.n_width					= n_size;
+		planes.n_height					= n_size;
+		planes.p_y						= &frame[0];
+		planes.p_u						= &frame[y_size];
+		planes.p_v						= &frame[y_size + uv_size];
+		planes.p_a						= &frame[y_size + 2 * uv_size];
+		planes.n_y_stride				= n_size;
+		planes.n_uv_stride				= n_uv_size;
+		planes.n_a_stride				= n_size;
+
+		if (!encoder.EncodeYUV(planes, expected[i], output_size))
+		{
+			state.SkipWithError("EncodeYUV failed");
+			return;
+		}
+
+		inputs[i].p_image				= &frame[0];
+		inputs[i].n_width				= n_size;
+		inputs[i].n_height				= n_size;
+		inputs[i].n_bytes_per_pixel		= 1;
+	}
+
+	const std::vector<std::vector<uint8_t> >	originals = frames;
+
+	WebpBenchmarkRecorder				recorder(state);
+
+	for (auto _ : state)
+	{
+		recorder.Start();
+
+		if (!encoder.EncodeBatch(&inputs[0], n_items, &outputs[0]))
+		{
+			state.SkipWithError("EncodeBatch failed");
+			break;
+		}
+
+		recorder.Stop();
+
+		bool							b_match = (frames == originals);
+
+		for (int i = 0; i < n_items && b_match; ++i)
+		{
+			b_match = (outputs[i].out_img == expected[i]);
+		}
+
+		if (!b_match)
+		{
+			state.SkipWithError("batch output differs from EncodeYUV or the frames were modified");
+			break;
+		}
+	}
+
+	recorder.Report((double)y_size * n_items, (double)frames[0].size() * n_items);
+}
+
+BENCHMARK(BM_EncodeBatchYUVA)
+	->ArgNames({ "size", "threads" })
+	->ArgsProduct({ { 256, 1024 }, { 1, 4 } })
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+
+/*
+* One of the image_io readers on the corpus file of its format, argument: size
+*/
+static void BM_ReadImage( benchmark::State &state, WEBP_BENCHMARK_FORMAT n_format )
+{
+	typedef int (*ImageReader)(const uint8_t* const, size_t, struct WebPPicture* const, int, struct Metadata* const);
+
+	static const ImageReader			kReaders[] = { ReadPNG, ReadJPEG, ReadTIFF, ReadPNM, ReadWebP };
+
+	const int							n_size	= (int)state.range(0);
+
+#ifndef WEBP_HAVE_PNG
+	if (n_format == WEBP_BENCHMARK_FORMAT_PNG)
+	{
+		state.SkipWithError("PNG support not compiled in");
+		return;
+	}
+#endif
+
+#ifndef WEBP_HAVE_JPEG
+	if (n_format == WEBP_BENCHMARK_FORMAT_JPEG)
+	{
+		state.SkipWithError("JPEG support not compiled in");
+		return;
+	}
+#endif
+
+#ifndef WEBP_HAVE_TIFF
+	if (n_format == WEBP_BENCHMARK_FORMAT_TIFF)
+	{
+		state.SkipWithError("TIFF support not compiled in");
+		return;
+	}
+#endif
+
+	const std::vector<uint8_t>			&file	= WebpBenchmarkGetFile(n_size, n_format);
+
+	if (file.empty())
+	{
+		state.SkipWithError("no corpus file for this format");
+		return;
+	}
+
+	WebpBenchmarkRecorder				recorder(state);
+
+	for (auto _ : state)
+	{
+		WebPPicture						picture;
+
+		WebPPictureInit(&picture);
+
+		picture.use_argb				= 1;
+
+		recorder.Start();
+
+		const int						b_ok = kReaders[n_format](&file[0], file.size(), &picture, 1, NULL);
+
+		recorder.Stop();
+
+		WebPPictureFree(&picture);
+
+		if (!b_ok)
+		{
+			state.SkipWithError("reader failed");
+			break;
+		}
+	}
+
+	recorder.Report((double)n_size * n_size, (double)file.size());
+
+	state.SetLabel(WebpBenchmarkGetFormatName(n_format));
+}
+
+BENCHMARK_CAPTURE(BM_ReadImage, png, WEBP_BENCHMARK_FORMAT_PNG)->ArgName("size")->Arg(256)->Arg(1024)->Arg(2048)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ReadImage, jpeg, WEBP_BENCHMARK_FORMAT_JPEG)->ArgName("size")->Arg(256)->Arg(1024)->Arg(2048)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ReadImage, tiff, WEBP_BENCHMARK_FORMAT_TIFF)->ArgName("size")->Arg(256)->Arg(1024)->Arg(2048)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ReadImage, pnm, WEBP_BENCHMARK_FORMAT_PNM)->ArgName("size")->Arg(256)->Arg(1024)->Arg(2048)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ReadImage, webp, WEBP_BENCHMARK_FORMAT_WEBP)->ArgName("size")->Arg(256)->Arg(1024)->Arg(2048)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/*
+* The WebP corpus file read from disk and decoded by ReadWebP, arguments: size, mapped (ImgIoUtilOpenFileView, otherwise the ImgIoUtilReadFile copy)
+*/
+static void BM_ReadFile( benchmark::State &state )
+{
+	const int							n_size		= (int)state.range(0);
+	const bool							b_mapped	= state.range(1) != 0;
+
+	const std::vector<uint8_t>			&file		= WebpBenchmarkGetFile(n_size, WEBP_BENCHMARK_FORMAT_WEBP);
+
+	char								file_name[64];
+
+	snprintf(file_name, sizeof(file_name), "webp_benchmark_%d.webp", n_size);
+
+	if (file.empty() || !ImgIoUtilWriteFile(file_name, &file[0], file.size()))
+	{
+		state.SkipWithError("cannot write the corpus file");
+		return;
+	}
+
+	WebpBenchmarkRecorder				recorder(state);
+
+	for (auto _ : state)
+	{
+		WebPPicture						picture;
+
+		ImgIoUtilFileView				view;
+
+		const uint8_t					*data = NULL;
+
+		size_t							data_size = 0;
+
+		WebPPictureInit(&picture);
+
+		picture.use_argb				= 1;
+
+		recorder.Start();
+
+		int								b_ok = b_mapped ? ImgIoUtilOpenFileView(file_name, &view) : ImgIoUtilReadFile(file_name, &data, &data_size);
+
+		if (b_ok)
+		{
+			b_ok = b_mapped ? ReadWebP(view.data, view.size, &picture, 1, NULL) : ReadWebP(data, data_size, &picture, 1, NULL);
+		}
+
+		if (b_mapped)
+		{
+			ImgIoUtilCloseFileView(&view);
+		}
+		else
+		{
+			free((void*)data);
+		}
+
+		recorder.Stop();
+
+		WebPPictureFree(&picture);
+
+		if (!b_ok)
+		{
+			state.SkipWithError("read failed");
+			break;
+		}
+	}
+
+	remove(file_name);
+
+	recorder.Report((double)n_size * n_size, (double)file.size());
+}
+
+BENCHMARK(BM_ReadFile)
+	->ArgNames({ "size", "mapped" })
+	->ArgsProduct({ { 1024, 2048 }, { 0, 1 } })
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,275 @@
+/********************************************************************************************************************************************************************************************
+* FileName   : WebPBenchmarkCorpus.cpp
+* Description: Deterministic synthetic images and their encoded forms for the benchmarks
+* Date		 : 17/10/2026
+* Author     : Ramesh Kumar K
+*
+********************************************************************************************************************************************************************************************/
+
+# include "WebPBenchmarkCorpus.h"
+# include "WebPencoder.h"
+# include <map>
+# include <stdio.h>
+# include <stdlib.h>
+# include <utility>
+
+# include "webp/decode.h"
+# include "imageio/image_enc.h"
+
+#ifdef WEBP_HAVE_JPEG
+# include <jpeglib.h>
+#endif
+
+/*
+* Small LCG, the corpus only needs to be the same everywhere, not random
+*/
+static uint32_t NextRandom( uint32_t &n_state )
+{
+	n_state = n_state * 1664525u + 1013904223u;
+
+	return n_state >> 8;
+}
+
+static void FillPixels( std::vector<uint8_t> &pixels, int n_size, WEBP_BENCHMARK_CONTENT n_content )
+{
+	static const uint8_t	kPalette[6][3] = { { 230, 57, 70 }, { 241, 250, 238 }, { 168, 218, 220 }, { 69, 123, 157 }, { 29, 53, 87 }, { 255, 183, 3 } };
+
+	uint32_t				n_seed	= 0x5eed1234u + (uint32_t)n_size;
+	const int				n_half	= n_size / 2;
+	const int				n_cell	= n_size / 8 > 0 ? n_size / 8 : 1;
+
+	pixels.resize((size_t)n_size * n_size * 4);
+
+	for (int y = 0; y < n_size; ++y)
+	{
+		uint8_t *row = &pixels[(size_t)y * n_size * 4];
+
+		for (int x = 0; x < n_size; ++x)
+		{
+			uint8_t *p = row + x * 4;
+
+			if (n_content == WEBP_BENCHMARK_CONTENT_PHOTO)
+			{
+				const int n_noise = (int)(NextRandom(n_seed) % 17) - 8;
+
+				const int r = (x * 255) / n_size + n_noise;
+				const int g = (y * 255) / n_size + n_noise;
+				const int b = ((x + y) * 127) / n_size + 64 + n_noise;
+
+				p[0] = (uint8_t)(r < 0 ? 0 : r > 255 ? 255 : r);
+				p[1] = (uint8_t)(g < 0 ? 0 : g > 255 ? 255 : g);
+				p[2] = (uint8_t)(b < 0 ? 0 : b > 255 ? 255 : b);
+			}
+			else
+			{
+				const uint8_t *colour = kPalette[((x / n_cell) * 3 + (y / n_cell) * 5) % 6];
+
+				p[0] = colour[0];
+				p[1] = colour[1];
+				p[2] = colour[2];
+			}
+
+			// opaque except for a soft edged hole in the middle, so the alpha paths get exercised
+
+			const int	dx			= x - n_half;
+			const int	dy			= y - n_half;
+			const long	n_dist2		= (long)dx * dx + (long)dy * dy;
+			const long	n_inner		= (long)(n_size / 8) * (n_size / 8);
+			const long	n_outer		= (long)(n_size / 6) * (n_size / 6);
+
+			p[3] = (n_dist2 <= n_inner) ? 0 : (n_dist2 >= n_outer) ? 255 : (uint8_t)((n_dist2 - n_inner) * 255 / (n_outer - n_inner + 1));
+		}
+	}
+}
+
+const std::vector<uint8_t>& WebpBenchmarkGetPixels( int n_size, WEBP_BENCHMARK_CONTENT n_content )
+{
+	static std::map<std::pair<int, int>, std::vector<uint8_t> >		cache;
+
+	std::vector<uint8_t> &pixels = cache[std::make_pair(n_size, (int)n_content)];
+
+	if (pixels.empty())
+	{
+		FillPixels(pixels, n_size, n_content);
+	}
+
+	return pixels;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Encoded files. PNG, TIFF and PNM go through the image_io writers into a temporary FILE, JPEG through libjpeg, WebP through our own encoder.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool WriteWithImageIO( const std::vector<uint8_t> &pixels, int n_size, int (*ptr_write)(FILE*, const WebPDecBuffer* const), std::vector<uint8_t> &file )
+{
+	WebPDecBuffer	buffer;
+
+	if (!WebPInitDecBuffer(&buffer))
+	{
+		return false;
+	}
+
+	buffer.colorspace			= MODE_RGBA;
+	buffer.width				= n_size;
+	buffer.height				= n_size;
+	buffer.is_external_memory	= 1;
+	buffer.u.RGBA.rgba			= (uint8_t*)&pixels[0];
+	buffer.u.RGBA.stride		= n_size * 4;
+	buffer.u.RGBA.size			= pixels.size();
+
+	FILE			*temp = tmpfile();
+
+	if (!temp)
+	{
+		return false;
+	}
+
+	bool			b_ok = ptr_write(temp, &buffer) != 0;
+
+	if (b_ok)
+	{
+		const long n_length = ftell(temp);
+
+		rewind(temp);
+
+		file.resize(n_length > 0 ? (size_t)n_length : 0);
+
+		b_ok = n_length > 0 && fread(&file[0], 1, file.size(), temp) == file.size();
+	}
+
+	fclose(temp);
+
+	if (!b_ok)
+	{
+		file.clear();
+	}
+
+	return b_ok;
+}
+
+static bool WriteJPEG( const std::vector<uint8_t> &pixels, int n_size, std::vector<uint8_t> &file )
+{
+#ifdef WEBP_HAVE_JPEG
+
+	jpeg_compress_struct		cinfo;
+	jpeg_error_mgr				jerr;
+
+	unsigned char				*p_output = NULL;
+	unsigned long				n_output = 0;
+
+	std::vector<uint8_t>		row((size_t)n_size * 3);
+
+	cinfo.err					= jpeg_std_error(&jerr);
+
+	jpeg_create_compress(&cinfo);
+	jpeg_mem_dest(&cinfo, &p_output, &n_output);
+
+	cinfo.image_width			= n_size;
+	cinfo.image_height			= n_size;
+	cinfo.input_components		= 3;
+	cinfo.in_color_space		= JCS_RGB;
+
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, 85, TRUE);
+	jpeg_start_compress(&cinfo, TRUE);
+
+	while (cinfo.next_scanline < cinfo.image_height)
+	{
+		const uint8_t *src = &pixels[(size_t)cinfo.next_scanline * n_size * 4];
+
+		for (int x = 0; x < n_size; ++x)
+		{
+			row[x * 3 + 0] = src[x * 4 + 0];
+			row[x * 3 + 1] = src[x * 4 + 1];
+			row[x * 3 + 2] = src[x * 4 + 2];
+		}
+
+		JSAMPROW row_pointer = &row[0];
+
+		jpeg_write_scanlines(&cinfo, &row_pointer, 1);
+	}
+
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+
+	file.assign(p_output, p_output + n_output);
+
+	free(p_output);
+
+	return !file.empty();
+
+#else
+
+	(void)pixels;
+	(void)n_size;
+	(void)file;
+
+	return false;
+
+#endif
+}
+
+static bool WriteWebP( const std::vector<uint8_t> &pixels, int n_size, std::vector<uint8_t> &file )
+{
+	WebpEncoder						encoder;
+
+	ImageCompressionProperties		properties;
+
+	properties.pixel_format			= PIXEL_FORMAT_RGBA;
+	properties.b_retain_alpha		= true;
+
+	if (!encoder.InitEncoder(properties))
+	{
+		return false;
+	}
+
+	std::vector<char>				out_img;
+
+	size_t							output_size = 0;
+
+	if (!encoder.EncodeImageWithStride(&pixels[0], n_size, n_size, 4, n_size * 4, out_img, output_size))
+	{
+		return false;
+	}
+
+	file.assign(out_img.begin(), out_img.begin() + output_size);
+
+	return true;
+}
+
+const std::vector<uint8_t>& WebpBenchmarkGetFile( int n_size, WEBP_BENCHMARK_FORMAT n_format )
+{
+	static std::map<std::pair<int, int>, std::vector<uint8_t> >		cache;
+	static std::map<std::pair<int, int>, bool>						tried;
+
+	const std::pair<int, int>	key(n_size, (int)n_format);
+
+	std::vector<uint8_t>		&file = cache[key];
+
+	if (file.empty() && !tried[key])
+	{
+		const std::vector<uint8_t> &pixels = WebpBenchmarkGetPixels(n_size, WEBP_BENCHMARK_CONTENT_PHOTO);
+
+		tried[key] = true;
+
+		switch (n_format)
+		{
+		case WEBP_BENCHMARK_FORMAT_PNG:		WriteWithImageIO(pixels, n_size, WebPWritePNG, file);	break;
+		case WEBP_BENCHMARK_FORMAT_JPEG:	WriteJPEG(pixels, n_size, file);						break;
+		case WEBP_BENCHMARK_FORMAT_TIFF:	WriteWithImageIO(pixels, n_size, WebPWriteTIFF, file);	break;
+		case WEBP_BENCHMARK_FORMAT_PNM:		WriteWithImageIO(pixels, n_size, WebPWritePAM, file);	break;
+		case WEBP_BENCHMARK_FORMAT_WEBP:	WriteWebP(pixels, n_size, file);						break;
+		}
+	}
+
+	return file;
+}
+
+const char* WebpBenchmarkGetFormatName( WEBP_BENCHMARK_FORMAT n_format )
+{
+	static const char* const kNames[] = { "PNG", "JPEG", "TIFF", "PNM", "WebP" };
+
+	return kNames[n_format];
+}
@@ -0,0 +1,38 @@
+#pragma once
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	WebPBenchmarkCorpus.h
+//
+//	Synthetic images for the benchmarks. The pixels come from a fixed seed so every run and every machine measures the same input,
+//	and the encoded files (PNG, JPEG, TIFF, PNM, WebP) are produced in memory on first use, so no test images ship with the tree.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+# include "stdint.h"
+# include <vector>
+
+enum WEBP_BENCHMARK_CONTENT
+{
+	WEBP_BENCHMARK_CONTENT_PHOTO,		// smooth gradients with sensor-like noise, what lossy encoding is for
+	WEBP_BENCHMARK_CONTENT_GRAPHIC		// flat shapes and few colours, what lossless encoding is for
+};
+
+enum WEBP_BENCHMARK_FORMAT
+{
+	WEBP_BENCHMARK_FORMAT_PNG,
+	WEBP_BENCHMARK_FORMAT_JPEG,
+	WEBP_BENCHMARK_FORMAT_TIFF,
+	WEBP_BENCHMARK_FORMAT_PNM,
+	WEBP_BENCHMARK_FORMAT_WEBP
+};
+
+/*
+* Square RGBA image of n_size x n_size pixels with a soft alpha edge, stride is n_size * 4
+*/
+const std::vector<uint8_t>&		WebpBenchmarkGetPixels		( int n_size, WEBP_BENCHMARK_CONTENT n_content );
+
+/*
+* The photo image of n_size encoded as n_format, empty when the codec isn't compiled in (e.g. no libjpeg)
+*/
+const std::vector<uint8_t>&		WebpBenchmarkGetFile		( int n_size, WEBP_BENCHMARK_FORMAT n_format );
+
+const char*						WebpBenchmarkGetFormatName	( WEBP_BENCHMARK_FORMAT n_format );
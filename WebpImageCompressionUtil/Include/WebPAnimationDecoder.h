@@ -0,0 +1,139 @@
+#pragma once
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	WebPAnimationDecoder.h
+//
+//	Animated WebP on top of WebPDemux. The frames are composited into one canvas owned by the decoder, and a keyframe table built
+//	when the file is opened lets it jump to any point of the animation by decoding from the closest keyframe before it instead
+//	of from the first frame, which is what WebPAnimDecoder would have to do.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+# include "stdint.h"
+# include "WebPPlatform.h"
+# include "WebPencoder.h"
+# include <vector>
+
+struct WebPDemuxer;
+
+struct WebpAnimationFrameInfo
+{
+	int													n_x_offset, n_y_offset;		// rectangle of the frame on the canvas
+
+	int													n_width, n_height;
+
+	int													n_timestamp_ms;		// when the frame is shown, from the start of the animation
+
+	int													n_duration_ms;
+
+	bool												b_has_alpha;
+
+	bool												b_blend;			// alpha blended over the canvas, otherwise its rectangle is replaced
+
+	bool												b_dispose_to_background;	// its rectangle is cleared to transparent before the next frame
+
+	bool												b_keyframe;			// the canvas after this frame doesn't depend on the frames before it
+};
+
+class WebpAnimationDecoder
+{
+
+public:
+
+	WebpAnimationDecoder												( );
+
+	~WebpAnimationDecoder												( );
+
+public:
+
+	// pixel_format is the canvas layout: PIXEL_FORMAT_RGBA, PIXEL_FORMAT_BGRA or PIXEL_FORMAT_RGBA_PREMULTIPLIED. The decoder reads the
+	// frames straight out of data, which has to stay valid until Close. Still images open as an animation of one frame.
+
+	bool		Open													( _In_ const uint8_t* data, _In_ size_t data_size, _In_ IMG_PIXEL_FORMATS pixel_format = PIXEL_FORMAT_RGBA );
+
+	void		Close													( );
+
+public:
+
+	int			GetFrameCount											( ) const;
+
+	int			GetCanvasWidth											( ) const;
+
+	int			GetCanvasHeight											( ) const;
+
+	int			GetLoopCount											( ) const;	// 0 loops forever
+
+	uint32_t	GetBackgroundColor										( ) const;	// a hint from the file, in BGRA byte order, the canvas itself starts transparent
+
+	int			GetDuration												( ) const;	// of one loop, in milliseconds
+
+	const WebpAnimationFrameInfo*	GetFrameInfo						( _In_ int n_frame ) const;	// frames count from 0, NULL when out of range
+
+	int			FindFrame												( _In_ int n_timestamp_ms ) const;	// the frame on screen at that time
+
+	int			FindKeyframe											( _In_ int n_frame ) const;	// the last keyframe at or before n_frame
+
+public:
+
+	// Composites the next frame and returns the canvas, canvas width * 4 bytes per row, valid until the next call. False after the last frame.
+
+	bool		GetNextFrame											( _Inout_ const uint8_t** canvas, _Inout_ int &n_timestamp_ms );
+
+	bool		HasMoreFrames											( ) const;
+
+	void		Reset													( );	// the next frame is the first one again
+
+	// Moves to the keyframe of the frame on screen at n_timestamp_ms without decoding anything, GetNextFrame continues from there
+
+	bool		SeekToKeyframe											( _In_ int n_timestamp_ms );
+
+	// The canvas exactly as shown at n_timestamp_ms. Only the frames from its keyframe on are decoded, or from the current canvas when it
+	// is already past that keyframe. GetNextFrame continues after the returned frame.
+
+	bool		DecodeFrameAt											( _In_ int n_timestamp_ms, _Inout_ const uint8_t** canvas, _Inout_ int &n_frame );
+
+private:
+
+				WebpAnimationDecoder									( const WebpAnimationDecoder & );
+
+	WebpAnimationDecoder&	operator=									( const WebpAnimationDecoder & );
+
+	bool		DecodeFrame												( _In_ int n_frame );
+
+	void		ClearRect												( _In_ int x, _In_ int y, _In_ int width, _In_ int height );
+
+	void		BlendFrame												( _In_ const WebpAnimationFrameInfo &info );
+
+private:
+
+	struct Payload
+	{
+		const uint8_t*													data;			// the frame's ALPH + VP8 or VP8L chunks inside the file
+
+		size_t															n_size;
+	};
+
+	WebPDemuxer*														m_demux;
+
+	std::vector<WebpAnimationFrameInfo>									m_frames;
+
+	std::vector<Payload>												m_payloads;
+
+	std::vector<uint8_t>												m_canvas;		// the only full size buffer, reused for every frame
+
+	std::vector<uint8_t>												m_frame;		// frames which blend are decoded here first
+
+	IMG_PIXEL_FORMATS													n_pixel_format;
+
+	int																	n_canvas_width;
+
+	int																	n_canvas_height;
+
+	int																	n_loop_count;
+
+	uint32_t															n_background_color;
+
+	int																	n_next_frame;
+
+	int																	n_canvas_frame;	// the frame the canvas shows, -1 when it holds nothing valid
+
+};
@@ -0,0 +1,147 @@
+#pragma once
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	WebPAnimationEncoder.h
+//
+//	Animated WebP from a sequence of timestamped frames, on top of WebPAnimEncoder. libwebp compares every frame with the canvas
+//	before it and only codes the rectangle that changed, choosing the blend and dispose methods that give the smaller frame, and
+//	inserts keyframes between kmin and kmax frames apart so players (and WebpAnimationDecoder) can seek without decoding from the start.
+//
+//	In pipelined mode AddFrame only converts the frame and queues it; a worker thread runs the much slower frame optimisation and
+//	encode, so the caller can produce the next frames meanwhile. The queue is bounded, AddFrame waits while it is full.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+# include "stdint.h"
+# include "WebPPlatform.h"
+# include "WebPencoder.h"
+# include <condition_variable>
+# include <deque>
+# include <mutex>
+# include <string>
+# include <thread>
+# include <vector>
+
+struct WebPAnimEncoder;
+
+struct WebpAnimationEncodeOptions
+{
+	int													n_loop_count;		// 0 loops forever
+
+	uint32_t											n_background_color;	// a hint for players, same byte order as WebpAnimationDecoder::GetBackgroundColor
+
+	bool												b_minimize_size;	// tries harder on every frame, much slower, and no keyframes are inserted
+
+	int													n_kmin;				// keyframe distance, 0 for both picks 9 - 17 for lossless and 3 - 5 for lossy
+
+	int													n_kmax;				// like gif2webp, a negative kmax disables keyframe insertion and 1 makes every frame a keyframe
+
+	bool												b_allow_mixed;		// every frame is tried both lossy and lossless and the smaller one is kept
+
+	bool												b_pipelined;		// encode on a worker thread while the caller adds frames
+
+	unsigned int										n_queue_depth;		// frames waiting for the worker, each one holds width * height * 4 bytes
+
+	WebpAnimationEncodeOptions()
+	{
+		n_loop_count = 0;
+
+		n_background_color = 0xffffffff;
+
+		b_minimize_size = false;
+
+		n_kmin = 0;
+
+		n_kmax = 0;
+
+		b_allow_mixed = false;
+
+		b_pipelined = false;
+
+		n_queue_depth = 4;
+	}
+};
+
+class WebpAnimationEncoder
+{
+
+public:
+
+	WebpAnimationEncoder												( );
+
+	~WebpAnimationEncoder												( );	// aborts an animation still in progress
+
+public:
+
+	// Quality, lossless, speed, alpha and pixel format of the frames come from config, the same way WebpEncoder::InitEncoder reads them.
+	// Rate control, scaling and the picture pool don't apply to animations and are ignored.
+
+	bool		InitEncoder												( _In_ ImageCompressionProperties &config, _In_ const WebpAnimationEncodeOptions &anim_options );
+
+	bool		Begin													( _In_ unsigned int width, _In_ unsigned int height );	// every frame covers the whole canvas
+
+	// n_stride is the size of a row in bytes, 0 for the default of the pixel format. Timestamps must not decrease; a frame lasts until the
+	// timestamp of the next one. The pixels are copied before AddFrame returns, so in_image can be reused right away.
+
+	bool		AddFrame												( _In_ const uint8_t* in_image, _In_ int n_timestamp_ms, _In_ unsigned int n_stride = 0 );
+
+	bool		AddFrame												( _In_ const uint8_t* in_image, _In_ int n_timestamp_ms, _In_ bool b_lossless, _In_ float f_quality_factor, _In_ unsigned int n_stride = 0 );	// overrides the config for this frame only
+
+	bool		Finish													( _In_ int n_end_timestamp_ms, _Inout_ std::vector<char> &out_img, _Inout_ size_t &output_size );	// n_end_timestamp_ms sets the duration of the last frame
+
+	void		Abort													( );
+
+	int			GetFrameCount											( ) const;	// frames added since Begin
+
+	std::string	GetLastError											( ) const;	// libwebp's message after a failure, empty otherwise. A copy, the worker may set it meanwhile
+
+private:
+
+				WebpAnimationEncoder									( const WebpAnimationEncoder & );
+
+	WebpAnimationEncoder&	operator=									( const WebpAnimationEncoder & );
+
+	bool		QueueFrame												( _In_ const uint8_t* in_image, _In_ int n_timestamp_ms, _In_ unsigned int n_stride, _In_ bool b_override, _In_ bool b_lossless, _In_ float f_quality_factor );
+
+	bool		EncodeFrame												( _Inout_ struct WebpAnimationFrame *frame );
+
+	void		WorkerLoop												( );
+
+	void		StopWorker												( );
+
+	void		SetError												( _In_ const char* error );
+
+private:
+
+	WebpEncoder															m_encoder;		// converts the frames and holds the validated config
+
+	WebpAnimationEncodeOptions											m_options;
+
+	bool																b_config_valid;
+
+	WebPAnimEncoder*													m_anim_encoder;	// NULL outside Begin / Finish
+
+	unsigned int														n_width;
+
+	unsigned int														n_height;
+
+	int																	n_frame_count;
+
+	int																	n_last_timestamp;
+
+	std::string															m_error;
+
+	// pipelined mode
+
+	std::thread															m_worker;
+
+	mutable std::mutex													m_lock;			// guards the queue, b_stop, b_failed and m_error
+
+	std::condition_variable												m_queue_changed;	// signalled on push, pop and stop
+
+	std::deque<struct WebpAnimationFrame*>								m_queue;
+
+	bool																b_stop;
+
+	bool																b_failed;		// set by the worker, the next call on the caller thread returns false
+
+};
@@ -0,0 +1,94 @@
+#pragma once
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	WebPDecodeBufferPool.h
+//
+//	Keeps the output buffers of finished decodes so the next image of the same or a slightly smaller size is decoded into memory
+//	that is already allocated. Buffers are 64 byte aligned and the stride is left to the caller, so they can be handed straight
+//	to texture uploads or staging copies.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+# include "stdint.h"
+# include "WebPPlatform.h"
+# include <mutex>
+# include <vector>
+
+struct WebpDecodeBufferPoolStats
+{
+	unsigned long long									n_hits;				// Acquire calls served from the pool
+
+	unsigned long long									n_misses;			// Acquire calls which had to allocate
+
+	unsigned long long									n_evictions;		// idle buffers freed to stay under the memory cap
+
+	size_t												n_idle_buffers;
+
+	size_t												n_idle_bytes;
+
+	size_t												n_bytes_in_use;		// buffers currently handed out
+
+	size_t												n_peak_bytes;		// highest idle + in use total seen
+
+	WebpDecodeBufferPoolStats()
+	{
+		n_hits = n_misses = n_evictions = 0;
+
+		n_idle_buffers = n_idle_bytes = n_bytes_in_use = n_peak_bytes = 0;
+	}
+};
+
+class WebpDecodeBufferPool
+{
+
+public:
+
+	explicit	WebpDecodeBufferPool									( _In_ size_t n_max_idle_bytes );
+
+				~WebpDecodeBufferPool									( );
+
+public:
+
+	uint8_t*	Acquire													( _In_ size_t n_bytes );	// NULL if the buffer can't be allocated, content is undefined
+
+	void		Release													( _In_ uint8_t *buffer );
+
+	size_t		GetCapacity												( _In_ const uint8_t *buffer ) const;	// 0 if the buffer isn't handed out by this pool
+
+	void		SetMaxIdleBytes											( _In_ size_t n_max_idle_bytes );
+
+	void		Clear													( );
+
+	WebpDecodeBufferPoolStats	GetStats								( ) const;
+
+private:
+
+				WebpDecodeBufferPool									( const WebpDecodeBufferPool & );
+
+	WebpDecodeBufferPool&	operator=									( const WebpDecodeBufferPool & );
+
+	void		TrimLocked												( );
+
+private:
+
+	struct Entry
+	{
+		uint8_t*														buffer;
+
+		size_t															n_bytes;
+
+		unsigned long long												n_last_used;
+	};
+
+	std::vector<Entry>													m_idle;
+
+	std::vector<Entry>													m_in_use;
+
+	size_t																n_max_idle_bytes;
+
+	unsigned long long													n_clock;		// LRU order of the idle entries
+
+	WebpDecodeBufferPoolStats											m_stats;
+
+	mutable std::mutex													m_lock;			// decoders on several threads may share one pool
+
+};
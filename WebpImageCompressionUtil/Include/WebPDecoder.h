@@ -5,7 +5,90 @@
 //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 # include "stdint.h"
-# include "WebpEncoder.h"
+# include "WebPPlatform.h"
+# include "WebPencoder.h"
+# include "WebPDecodeBufferPool.h"
+# include <vector>
+
+enum WEBP_IMAGE_CODING
+{
+	WEBP_IMAGE_CODING_UNKNOWN	= 0,		// mixed (animations) or not in the prefix probed yet
+	WEBP_IMAGE_CODING_LOSSY		= 1,
+	WEBP_IMAGE_CODING_LOSSLESS	= 2
+};
+
+/*
+* What Probe reads from the RIFF, VP8X, VP8 and VP8L headers. For animations width and height are the canvas size.
+*/
+struct WebpImageInfo
+{
+	int													width;
+
+	int													height;
+
+	bool												b_has_alpha;
+
+	bool												b_is_animated;
+
+	WEBP_IMAGE_CODING									n_coding;
+
+	int													n_status;			// VP8StatusCode, VP8_STATUS_NOT_ENOUGH_DATA when the prefix ends before the headers do
+
+	WebpImageInfo()
+	{
+		width = height = 0;
+
+		b_has_alpha = b_is_animated = false;
+
+		n_coding = WEBP_IMAGE_CODING_UNKNOWN;
+
+		n_status = 0;
+	}
+};
+
+/*
+* Options of libwebp's advanced decoding API. Cropping is applied first and the cropped area is scaled afterwards, inside the decoder
+* instead of on a full size output. The rest trade a little quality or a second core for latency.
+*/
+struct WebpDecodeOptions
+{
+	bool												b_use_cropping;
+
+	int													n_crop_left, n_crop_top;		// libwebp rounds them down to even for YUV output
+
+	int													n_crop_width, n_crop_height;
+
+	bool												b_use_scaling;
+
+	int													n_scaled_width, n_scaled_height;	// one of them 0 keeps the aspect ratio of the (cropped) image
+
+	bool												b_use_threads;			// lossy only: filtering runs on a second thread, pays off from about 1 Mpx
+
+	bool												b_bypass_filtering;		// lossy only: skips the in-loop deblocking filter, faster but blockier
+
+	bool												b_no_fancy_upsampling;	// lossy only: pointwise chroma upsampling instead of the bilinear one
+
+	int													n_dithering_strength;	// 0 (off) to 100, dithers the output of strongly quantized lossy images
+
+	int													n_alpha_dithering_strength;	// 0 (off) to 100, smooths quantized alpha planes
+
+	bool												b_flip;					// bottom-up output, e.g. for OpenGL textures or BMP
+
+	WebpDecodeOptions()
+	{
+		b_use_cropping = false;
+
+		n_crop_left = n_crop_top = n_crop_width = n_crop_height = 0;
+
+		b_use_scaling = false;
+
+		n_scaled_width = n_scaled_height = 0;
+
+		b_use_threads = b_bypass_filtering = b_no_fancy_upsampling = b_flip = false;
+
+		n_dithering_strength = n_alpha_dithering_strength = 0;
+	}
+};
 
 class WebpDecoder
 {
@@ -14,6 +97,8 @@ private:
 
 	uint8_t* (*ptr_decode_image)										( _In_ const uint8_t* data, _In_ size_t data_size, _In_ int* width, _In_ int* height); // function ptr to hold the decoder function's address
 
+	uint8_t* (*ptr_decode_into)											( _In_ const uint8_t* data, _In_ size_t data_size, _Inout_ uint8_t* output_buffer, _In_ size_t output_buffer_size, _In_ int output_stride );	// the *Into variant of the same pixel format
+
 public:
 
 	WebpDecoder															( );
@@ -27,14 +112,136 @@ public:
 
 	bool		SetOutPutPixelFormat									( IMG_PIXEL_FORMATS pixel_format );
 
+	bool		SetDecodeOptions										( _In_ const WebpDecodeOptions &options );	// applies to every Decode* call that follows
+
+	const WebpDecodeOptions&	GetDecodeOptions						( ) const;
+
+	static void	SetInstructionSetCeiling								( _In_ WEBP_KERNEL_ISA n_ceiling );	// process wide, shared with the encoder
+
+	static WEBP_KERNEL_ISA	GetInstructionSet							( );
+
 public:
 
-	bool		DecodeImage												( _In_ const uint8_t* in_image, _In_ size_t image_size, _In_ int &width, _In_ int &height, _Inout_ uint8_t** out_image );
+	bool		DecodeImage												( _In_ const uint8_t* in_image, _In_ size_t image_size, _In_ int &width, _In_ int &height, _Inout_ uint8_t** out_image );	// *out_image is released with FreeImage
+
+	// Decodes into memory the caller owns, nothing is allocated for the pixels. out_buffer_size has to cover GetOutputBufferSize, width and
+	// height are returned even when the buffer is too small so the caller can size it and retry. For YUV420/YUVA420 out_stride is the Y
+	// stride and the planes follow each other as in the encoder's planar input.
+
+	bool		DecodeInto												( _In_ const uint8_t* in_image, _In_ size_t image_size, _Inout_ uint8_t* out_buffer, _In_ size_t out_buffer_size, _In_ int out_stride, _Inout_ int &width, _Inout_ int &height );
+
+	// Decodes into a buffer taken from pool, rows are out_stride bytes apart (0 packs them). The buffer goes back with pool.Release.
+
+	bool		DecodePooled											( _In_ const uint8_t* in_image, _In_ size_t image_size, _Inout_ WebpDecodeBufferPool &pool, _In_ int out_stride, _Inout_ int &width, _Inout_ int &height, _Inout_ uint8_t** out_image );
+
+	static void	FreeImage												( _In_ uint8_t* image );
+
+	// Reads only the container and frame headers, nothing is decoded or allocated. A prefix of the file is enough: 30 bytes give the size,
+	// alpha and animation flags. Lossy images with alpha store the ALPH chunk before the VP8 one, so their n_coding is only known once the
+	// prefix reaches past it. Returns false with n_status VP8_STATUS_NOT_ENOUGH_DATA when more bytes are needed.
+
+	static bool	Probe													( _In_ const uint8_t* in_image, _In_ size_t data_size, _Inout_ WebpImageInfo &info );
+
+	int			GetBytesPerPixel										( ) const;	// of the Y plane for YUV420 and YUVA420
+
+	size_t		GetOutputBufferSize										( _In_ int width, _In_ int height, _In_ int out_stride ) const;	// out_stride 0 packs the rows
+
+	bool		GetOutputSize											( _In_ const uint8_t* in_image, _In_ size_t data_size, _Inout_ int &width, _Inout_ int &height ) const;	// after cropping and scaling
+
+private:
+
+	friend class WebpDecodeSession;		// decodes with the pixel format and options of the decoder it started from
 
+	bool		DecodeAdvanced											( _In_ const uint8_t* in_image, _In_ size_t data_size, _Inout_ uint8_t* out_buffer, _In_ size_t out_buffer_size, _In_ int out_stride, _Inout_ int &width, _Inout_ int &height, _Inout_ uint8_t** out_image );
 
 private:
 
 	IMG_PIXEL_FORMATS													n_pixel_format;
 
+	WebpDecodeOptions													m_options;
+
+	bool																b_use_advanced_api;		// some option is set, which needs WebPDecode with a WebPDecoderConfig
+
+
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	Incremental decoding on top of WebPIDecoder, for files which arrive in pieces. Every Push appends the new bytes and reports the
+//	rows which became final, so they can be consumed while the rest of the file is still downloading.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+enum WEBP_DECODE_SESSION_STATUS
+{
+	WEBP_DECODE_SESSION_NEED_MORE_DATA,
+	WEBP_DECODE_SESSION_DONE,
+	WEBP_DECODE_SESSION_ERROR
+};
+
+struct WebPIDecoder;
+struct WebPDecoderConfig;
+
+class WebpDecodeSession
+{
+
+public:
+
+	WebpDecodeSession													( );
+
+	~WebpDecodeSession													( );
+
+public:
+
+	// Takes the output pixel format and WebpDecodeOptions of decoder. Without out_buffer libwebp allocates the output once the headers are
+	// in and it stays valid until End, with one it has to fit the output size (see WebpDecoder::GetOutputSize).
+
+	bool		Begin													( _In_ const WebpDecoder &decoder, _Inout_opt_ uint8_t* out_buffer = NULL, _In_ size_t out_buffer_size = 0, _In_ int out_stride = 0 );
+
+	// Rows [first_row, first_row + n_rows) were completed by this call, n_rows may be 0 when the bytes only finished part of a row
+
+	WEBP_DECODE_SESSION_STATUS	Push									( _In_ const uint8_t* data, _In_ size_t data_size, _Inout_ int &first_row, _Inout_ int &n_rows );
+
+	// The output so far, rows [0, n_rows) are final. NULL until the headers have been parsed, the Y plane for the YUV formats.
+
+	const uint8_t*	GetRows												( _Inout_ int &n_rows, _Inout_ int &width, _Inout_ int &height, _Inout_ int &stride ) const;
+
+	int			GetLastStatus											( ) const;	// VP8StatusCode of the last Push
+
+	void		End														( );
+
+private:
+
+				WebpDecodeSession										( const WebpDecodeSession & );
+
+	WebpDecodeSession&	operator=										( const WebpDecodeSession & );
+
+	bool		StartDecoder											( );
+
+private:
+
+	WebpDecoder															m_decoder;
+
+	WebPDecoderConfig*													m_config;		// outlives m_idec, which keeps pointers into it
+
+	WebPIDecoder*														m_idec;			// NULL until the headers are complete
+
+	std::vector<uint8_t>												m_header;		// the first bytes, held until the output size is known
+
+	uint8_t*															m_out_buffer;
+
+	size_t																n_out_buffer_size;
+
+	int																	n_out_stride;
+
+	int																	n_rows_done;
+
+	int																	n_status;
+
+	WEBP_DECODE_SESSION_STATUS											n_state;
+
+	size_t																n_bytes_in;
+
+	uint64_t															n_metrics_start;
 
-};
\ No newline at end of file
+};
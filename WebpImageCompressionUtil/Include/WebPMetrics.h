@@ -0,0 +1,75 @@
+#pragma once
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	WebPMetrics.h
+//
+//	Process wide counters and latency histograms of the hot paths: picture import, encode, decode and the image_io readers. Every
+//	slot is a relaxed atomic so recording never takes a lock, and the recording macros test one flag first, so the cost while the
+//	registry is disabled is a load and a branch. Define WEBP_NO_METRICS to compile the macros out entirely.
+//
+//	WebpMetricsDump writes everything in the Prometheus text exposition format for the host application to serve or log.
+//
+//	Plain C interface so the image_io readers can use it as well as the encoder and the decoder.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+# include "stdint.h"
+# include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+	WEBP_METRIC_OP_IMPORT,			// packed RGB(A) or YUV planes into a WebPPicture
+	WEBP_METRIC_OP_ENCODE,			// WebPEncode of an imported picture, error codes are VP8_ENC_ERROR_*
+	WEBP_METRIC_OP_DECODE,			// WebpDecoder, error codes are VP8StatusCode
+	WEBP_METRIC_OP_READ_PNG,
+	WEBP_METRIC_OP_READ_JPEG,
+	WEBP_METRIC_OP_READ_TIFF,
+	WEBP_METRIC_OP_READ_WEBP,
+	WEBP_METRIC_OP_READ_PNM,
+	WEBP_METRIC_OP_COUNT
+} WEBP_METRIC_OP;
+
+#define WEBP_METRIC_MAX_ERROR_CODES		16		// larger codes are counted in the last slot
+
+/*
+* Collection starts disabled. Enabling or disabling is safe at any time, an operation already started when the flag flips may or may not be counted.
+*/
+void					WebpMetricsSetEnabled	( int b_enabled );
+
+int						WebpMetricsIsEnabled	( void );
+
+uint64_t				WebpMetricsNow			( void );		// monotonic nanoseconds, the start argument of WebpMetricsRecord
+
+/*
+* Counts one operation started at n_start_ns. n_pixels selects the size bucket of the latency histogram, n_error_code is 0 on success.
+*/
+void					WebpMetricsRecord		( WEBP_METRIC_OP n_op, uint64_t n_start_ns, uint64_t n_pixels, uint64_t n_bytes_in, uint64_t n_bytes_out, int n_error_code );
+
+/*
+* Writes the registry as Prometheus text into buffer and null terminates it. Returns the length of the full text, when that is not smaller than
+* n_capacity the output was truncated and the call can be repeated with a bigger buffer.
+*/
+size_t					WebpMetricsDump			( char* buffer, size_t n_capacity );
+
+void					WebpMetricsReset		( void );
+
+#ifdef __cplusplus
+}    // extern "C"
+#endif
+
+#ifndef WEBP_NO_METRICS
+
+#define WEBP_METRICS_START(start_ns)													const uint64_t start_ns = WebpMetricsIsEnabled() ? WebpMetricsNow() : 0
+
+#define WEBP_METRICS_RECORD(op, start_ns, pixels, bytes_in, bytes_out, error_code)		do { if ((start_ns) != 0) WebpMetricsRecord((op), (start_ns), (pixels), (bytes_in), (bytes_out), (error_code)); } while (0)
+
+#else
+
+#define WEBP_METRICS_START(start_ns)													const uint64_t start_ns = 0
+
+#define WEBP_METRICS_RECORD(op, start_ns, pixels, bytes_in, bytes_out, error_code)		do { (void)(start_ns); } while (0)
+
+#endif
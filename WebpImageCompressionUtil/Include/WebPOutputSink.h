@@ -0,0 +1,146 @@
+#pragma once
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	WebPOutputSink.h
+//
+//	Destinations for the bitstream of WebpEncoder::EncodeImageToSink, which hands every chunk libwebp writes to Write, then calls Finish
+//	on success or Abort on failure. libwebp only calls its writer once the whole image is compressed (VP8EncWrite / VP8LEncodeImage
+//	assemble the bitstream first), so output starts after the encode and not during it. What a sink saves is the copy into a vector:
+//	the chunks go straight to the file, socket or ring buffer.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+# include "stdint.h"
+# include "WebPPlatform.h"
+# include <condition_variable>
+# include <mutex>
+# include <vector>
+
+class WebpOutputSink
+{
+
+public:
+
+	virtual		~WebpOutputSink											( ) {}
+
+public:
+
+	virtual bool	Write												( _In_ const uint8_t* data, _In_ size_t data_size ) = 0;	// false stops the encode
+
+	virtual bool	Finish												( ) = 0;
+
+	virtual void	Abort												( ) = 0;
+
+};
+
+/*
+* Writes to a file descriptor or socket, the descriptor is closed by Finish/Abort only if b_close is set
+*/
+class WebpFileDescriptorSink : public WebpOutputSink
+{
+
+public:
+
+	explicit	WebpFileDescriptorSink									( _In_ int fd, _In_ bool b_close_fd = false );
+
+				~WebpFileDescriptorSink									( );
+
+public:
+
+	bool		Write													( _In_ const uint8_t* data, _In_ size_t data_size );
+
+	bool		Finish													( );
+
+	void		Abort													( );
+
+	size_t		GetBytesWritten											( ) const;
+
+private:
+
+	void		Close													( );
+
+private:
+
+	int																	n_fd;
+
+	bool																b_close;
+
+	size_t																n_bytes_written;
+
+};
+
+/*
+* Collects the bitstream in memory, kept for callers which want the sink interface but still need the whole file
+*/
+class WebpMemorySink : public WebpOutputSink
+{
+
+public:
+
+				WebpMemorySink											( );
+
+public:
+
+	bool		Write													( _In_ const uint8_t* data, _In_ size_t data_size );
+
+	bool		Finish													( );
+
+	void		Abort													( );
+
+	const std::vector<char>&	GetData									( ) const;
+
+	bool		IsComplete												( ) const;
+
+private:
+
+	std::vector<char>													m_data;
+
+	bool																b_complete;
+
+};
+
+/*
+* Bounded ring buffer between the encoding thread and a consumer thread (e.g. one sending to a socket). Write blocks while the buffer is full,
+* Read blocks until data is available, so the sink itself holds at most n_capacity bytes; libwebp still holds the whole bitstream while it writes.
+*/
+class WebpRingBufferSink : public WebpOutputSink
+{
+
+public:
+
+	explicit	WebpRingBufferSink										( _In_ size_t n_capacity );
+
+public:
+
+	bool		Write													( _In_ const uint8_t* data, _In_ size_t data_size );
+
+	bool		Finish													( );
+
+	void		Abort													( );
+
+public:
+
+	size_t		Read													( _Inout_ uint8_t* buffer, _In_ size_t buffer_size );	// 0 once the stream is finished or aborted
+
+	void		CancelRead												( );	// consumer side shutdown, the pending and next writes fail
+
+	bool		IsAborted												( ) const;
+
+private:
+
+	std::vector<uint8_t>												m_buffer;
+
+	size_t																n_head;			// next byte to read
+
+	size_t																n_size;			// bytes waiting to be read
+
+	bool																b_finished;
+
+	bool																b_aborted;
+
+	mutable std::mutex													m_lock;
+
+	std::condition_variable												m_not_full;
+
+	std::condition_variable												m_not_empty;
+
+};
@@ -0,0 +1,123 @@
+#pragma once
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	WebPPicturePool.h
+//
+//	Keeps WebPPictures with allocated planes, keyed by (width, height, has_alpha, use_argb), so a stream of same-sized frames reuses
+//	the same Y/U/V/A or ARGB memory instead of allocating and freeing it for every image. libwebp's import functions always
+//	reallocate the planes, so pooled pictures are filled by our own converters which write into the existing planes. The RGB -> YUV
+//	converter is a port of libwebp's (gamma corrected chroma, alpha weighted on translucent blocks), so pooling doesn't change the
+//	bitstream; it is scalar like libwebp's for 4 byte pixels, libwebp only vectorises the Y of 3 byte RGB.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+# include "stdint.h"
+# include "WebPPlatform.h"
+# include <mutex>
+# include <vector>
+
+#ifdef _USE_WEBP_
+# include "webp/encode.h"
+#endif
+
+struct WebpPicturePoolStats
+{
+	unsigned long long									n_hits;				// Acquire calls served from the pool
+
+	unsigned long long									n_misses;			// Acquire calls which had to allocate
+
+	unsigned long long									n_evictions;		// idle pictures freed to stay under the memory cap
+
+	size_t												n_idle_pictures;
+
+	size_t												n_idle_bytes;
+
+	size_t												n_bytes_in_use;		// planes currently handed out
+
+	size_t												n_peak_bytes;		// highest idle + in use total seen
+
+	WebpPicturePoolStats()
+	{
+		n_hits = n_misses = n_evictions = 0;
+
+		n_idle_pictures = n_idle_bytes = n_bytes_in_use = n_peak_bytes = 0;
+	}
+};
+
+/*
+* Byte position of each channel inside a packed pixel, n_a is -1 when the input has no alpha to keep
+*/
+struct WebpPackedLayout
+{
+	int													n_bytes_per_pixel;
+
+	int													n_r, n_g, n_b, n_a;
+};
+
+#ifdef _USE_WEBP_
+
+class WebpPicturePool
+{
+
+public:
+
+	explicit	WebpPicturePool											( _In_ size_t n_max_idle_bytes );
+
+				~WebpPicturePool										( );
+
+public:
+
+	WebPPicture*	Acquire												( _In_ int width, _In_ int height, _In_ bool b_has_alpha, _In_ bool b_use_argb );	// NULL if the planes can't be allocated
+
+	void		Release													( _In_ WebPPicture *picture );
+
+	void		SetMaxIdleBytes											( _In_ size_t n_max_idle_bytes );
+
+	void		Clear													( );
+
+	WebpPicturePoolStats	GetStats									( ) const;
+
+public:
+
+	// Fills a pooled picture from packed 8 bit pixels without touching its allocation, alpha is opaque when layout.n_a < 0. Only rows
+	// [first_row, first_row + n_rows) are written, first_row has to be even so callers can split a picture in bands.
+
+	static bool	ImportPackedRows										( _Inout_ WebPPicture *picture, _In_ const uint8_t* data, _In_ int stride, _In_ const WebpPackedLayout &layout, _In_ int first_row, _In_ int n_rows );
+
+	static size_t	GetPictureBytes										( _In_ int width, _In_ int height, _In_ bool b_has_alpha, _In_ bool b_use_argb );
+
+private:
+
+				WebpPicturePool											( const WebpPicturePool & );
+
+	WebpPicturePool&	operator=										( const WebpPicturePool & );
+
+	void		TrimLocked												( );
+
+private:
+
+	struct Entry
+	{
+		WebPPicture*													picture;
+
+		size_t															n_bytes;
+
+		bool															b_has_alpha;
+
+		unsigned long long												n_last_used;
+	};
+
+	std::vector<Entry>													m_idle;
+
+	std::vector<Entry>													m_in_use;
+
+	size_t																n_max_idle_bytes;
+
+	unsigned long long													n_clock;		// LRU order of the idle entries
+
+	WebpPicturePoolStats												m_stats;
+
+	mutable std::mutex													m_lock;			// one pool serves all the batch workers
+
+};
+
+#endif
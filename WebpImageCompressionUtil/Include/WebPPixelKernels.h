@@ -0,0 +1,70 @@
+#pragma once
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	WebPPixelKernels.h
+//
+//	Row kernels used to prepare pixels before encoding: channel shuffle, alpha fill, premultiply/unpremultiply and blending over a
+//	background. Every kernel has a scalar version and SIMD versions on x86 (SSE2 to AVX2), the best one the CPU supports is picked at
+//	the first call of WebpGetPixelKernels. All the versions of a kernel give bit-identical results.
+//
+//	WebpSetIsaCeiling caps the instruction set process wide, for our kernels and for libwebp's own DSP code through its
+//	VP8GetCPUInfo hook, so the SIMD paths can be compared or pinned on mixed hardware.
+//
+//	Plain C interface so the image_io readers can use it as well as the encoder.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+# include "stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+	WEBP_KERNEL_ISA_SCALAR,
+	WEBP_KERNEL_ISA_SSE2,
+	WEBP_KERNEL_ISA_SSSE3,
+	WEBP_KERNEL_ISA_SSE41,
+	WEBP_KERNEL_ISA_AVX2,
+	WEBP_KERNEL_ISA_COUNT
+} WEBP_KERNEL_ISA;
+
+/*
+* Pixels are 4 bytes with alpha in byte 3 (RGBA, BGRA, or ARGB words on a little endian CPU), n_pixels is the length of the row. src and dst
+* may be the same buffer.
+*/
+typedef struct WebpPixelKernels
+{
+	void	(*ptr_shuffle)				( const uint8_t* src, uint8_t* dst, int n_pixels, const uint8_t order[4] );	// dst byte i = src byte order[i]
+
+	void	(*ptr_fill_alpha)			( uint32_t* pixels, int n_pixels );						// pixels[i] |= 0xff000000
+
+	void	(*ptr_premultiply)			( uint8_t* pixels, int n_pixels );						// c = round(c * a / 255)
+
+	void	(*ptr_unpremultiply)		( uint8_t* pixels, int n_pixels );						// same 24 bit fixed point as libwebp's WebPMultARGBRow
+
+	void	(*ptr_blend_to_background)	( uint8_t* pixels, int n_pixels, uint32_t background );	// byte c becomes (c * a + bg_c * (255 - a)) / 255 rounded as WebPBlendAlpha, alpha 255. bg_c = (background >> 8c) & 0xff
+
+	WEBP_KERNEL_ISA						n_isa;		// instruction set the table was built for
+
+} WebpPixelKernels;
+
+const WebpPixelKernels*	WebpGetPixelKernels		( void );
+
+WEBP_KERNEL_ISA			WebpGetCpuKernelIsa		( void );		// best instruction set of this CPU
+
+/*
+* Highest instruction set the kernels and libwebp may use, WEBP_KERNEL_ISA_AVX2 (the default) means no limit. libwebp picks up a new ceiling the
+* next time an encoder or decoder initialises its DSP functions, so set it before starting work rather than while other threads encode.
+*/
+void					WebpSetIsaCeiling		( WEBP_KERNEL_ISA n_ceiling );
+
+WEBP_KERNEL_ISA			WebpGetIsaCeiling		( void );
+
+WEBP_KERNEL_ISA			WebpGetActiveIsa		( void );		// what runs: the CPU's best capped by the ceiling
+
+const char*				WebpGetIsaName			( WEBP_KERNEL_ISA n_isa );
+
+#ifdef __cplusplus
+}    // extern "C"
+#endif
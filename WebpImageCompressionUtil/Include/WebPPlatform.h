@@ -0,0 +1,53 @@
+#pragma once
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	WebPPlatform.h
+//
+//	The sources are written against the Windows SDK: SAL annotations on the parameters, TCHAR file names and the _T() literal macro.
+//	On Windows this header only pulls in the SDK headers which define them, elsewhere it maps them to their plain char equivalents
+//	so the same sources build with GCC and Clang.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifdef _WIN32
+
+# include <sal.h>
+# include <tchar.h>
+
+#else
+
+#ifndef _In_
+# define _In_
+#endif
+
+#ifndef _In_opt_
+# define _In_opt_
+#endif
+
+#ifndef _Inout_
+# define _Inout_
+#endif
+
+#ifndef _Inout_opt_
+# define _Inout_opt_
+#endif
+
+#ifndef _Out_
+# define _Out_
+#endif
+
+#ifndef _Out_opt_
+# define _Out_opt_
+#endif
+
+#ifndef _T
+# define _T(x)		x
+#endif
+
+#ifndef _tfopen
+# define _tfopen	fopen
+#endif
+
+typedef char		TCHAR;
+
+#endif
@@ -0,0 +1,84 @@
+#pragma once
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//	WebPThreadPool.h
+//
+//	Small work-stealing pool used to spread encode jobs over the available cores. Every worker owns a queue of job indices,
+//	pops from its front and steals from the back of the other queues once its own queue runs dry.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+# include "stdint.h"
+# include "WebPPlatform.h"
+# include <atomic>
+# include <condition_variable>
+# include <deque>
+# include <functional>
+# include <mutex>
+# include <thread>
+# include <vector>
+
+class WebpThreadPool
+{
+
+public:
+
+	typedef std::function<void (size_t n_index, unsigned int n_worker_id)>	Task;		// n_worker_id is in [0, GetThreadCount())
+
+public:
+
+	explicit	WebpThreadPool											( unsigned int n_threads );		// 0 picks the number of hardware threads
+
+				~WebpThreadPool											( );
+
+public:
+
+	unsigned int	GetThreadCount										( ) const;
+
+	void		ParallelFor												( _In_ size_t n_count, _In_ const Task &task );	// runs task for [0, n_count) and waits, the calling thread works as worker 0
+
+	static unsigned int	GetHardwareThreadCount							( );
+
+private:
+
+				WebpThreadPool											( const WebpThreadPool & );
+
+	WebpThreadPool&	operator=											( const WebpThreadPool & );
+
+	void		WorkerLoop												( unsigned int n_worker_id );
+
+	void		RunTasks												( unsigned int n_worker_id );
+
+	bool		PopTask													( unsigned int n_worker_id, size_t &n_index );
+
+private:
+
+	struct WorkQueue
+	{
+		std::mutex														lock;
+
+		std::deque<size_t>												items;
+	};
+
+	std::vector<std::thread>											m_threads;
+
+	std::vector<WorkQueue*>												m_queues;		// one per worker, including the calling thread
+
+	std::mutex															m_job_lock;		// serialises ParallelFor calls
+
+	std::mutex															m_state_lock;
+
+	std::condition_variable												m_wake;
+
+	std::condition_variable												m_done;
+
+	const Task*															m_task;
+
+	std::atomic<size_t>													m_pending;
+
+	unsigned int														m_active_workers;
+
+	unsigned long long													m_generation;
+
+	bool																b_stop;
+
+};
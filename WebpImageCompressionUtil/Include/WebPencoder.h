@@ -5,15 +5,49 @@
 //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 # include "stdint.h"
+# include "WebPPlatform.h"
+# include <string.h>
 # include <vector>
+# include "WebPPicturePool.h"
+# include "WebPPixelKernels.h"
+
+#ifdef _USE_WEBP_
+# include "webp/encode.h"
+#endif
 
 using namespace std;
 
-enum IMG_PIXEL_FORMATS { PIXEL_FORMAT_RGBA, PIXEL_FORMAT_RGB };
+/*
+* Layout of the pixels handed to the encoder. Packed formats are 8 bits per channel in the listed byte order, the X of RGBX/BGRX is ignored.
+* The planar YUV formats are I420: a Y plane of 'stride' bytes per row, then the U and V planes of (stride + 1) / 2 bytes per row, and for
+* YUVA420 a full resolution alpha plane of 'stride' bytes per row after them. YUV planes are encoded in place without a copy and are never
+* written to; with alpha they are copied first unless the config asks for exact encoding, as libwebp would rewrite transparent pixels.
+*/
+enum IMG_PIXEL_FORMATS
+{
+	PIXEL_FORMAT_RGBA,
+	PIXEL_FORMAT_RGB,
+	PIXEL_FORMAT_RGBX,
+	PIXEL_FORMAT_BGR,
+	PIXEL_FORMAT_BGRA,
+	PIXEL_FORMAT_BGRX,
+	PIXEL_FORMAT_ARGB,
+	PIXEL_FORMAT_RGBA_PREMULTIPLIED,
+	PIXEL_FORMAT_YUV420,
+	PIXEL_FORMAT_YUVA420,
+	PIXEL_FORMAT_RGB565,					// decoder output only, 5-6-5 bits in 2 bytes
+	PIXEL_FORMAT_RGBA4444					// decoder output only, 4 bits per channel in 2 bytes
+};
 
 struct ImageCompressionProperties
 {
-	unsigned int												n_bit_rate;
+	unsigned int												n_bit_rate;			// rate control budget in kilobits per image, 0 disables it
+
+	size_t												n_target_size;		// rate control budget in bytes, takes precedence over n_bit_rate
+
+	float												f_target_psnr;		// rate control on quality (dB), used when there is no size budget
+
+	int													n_rate_control_passes;	// libwebp search passes (1 - 10) when a target is set
 
 	IMG_PIXEL_FORMATS									pixel_format;
 
@@ -35,10 +69,18 @@ struct ImageCompressionProperties
 
 	bool												b_apply_histrogram_equalization;
 
-	bool												b_use_sse2_instruction_set;
+	bool												b_use_sse2_instruction_set;	// false makes InitEncoder fail unless the process wide ceiling is already scalar, see WebpEncoder::SetInstructionSetCeiling
 
 	bool												b_use_parallel_processing;
 
+	unsigned int										n_thread_count;		// threads used when b_use_parallel_processing is set, 0 means one per hardware thread
+
+	bool												b_use_picture_pool;	// reuse the picture planes of same-sized images instead of allocating them per encode
+
+	size_t												n_picture_pool_max_bytes;	// memory the pool may keep for idle pictures
+
+	bool												b_collect_stats;	// fill a WebpEncodeStats on every encode, see GetLastEncodeStats
+
 	bool												b_use_gpu_for_processing;
 
 
@@ -47,6 +89,12 @@ struct ImageCompressionProperties
 	{
 		n_bit_rate = 0;
 
+		n_target_size = 0;
+
+		f_target_psnr = 0;
+
+		n_rate_control_passes = 6;
+
 		pixel_format = PIXEL_FORMAT_RGBA;
 
 		b_use_lossless_image_compression = false;
@@ -59,6 +107,10 @@ struct ImageCompressionProperties
 
 		b_retain_alpha = false;
 
+		n_alpha_quality = 100;
+
+		n_speed = 4;
+
 		b_use_gamma_correction = false;
 
 		b_apply_histrogram_equalization = false;
@@ -67,10 +119,294 @@ struct ImageCompressionProperties
 
 		b_use_parallel_processing = true;
 
+		n_thread_count = 0;
+
+		b_use_picture_pool = false;
+
+		n_picture_pool_max_bytes = 64 * 1024 * 1024;
+
+		b_collect_stats = false;
+
 		b_use_gpu_for_processing = true;
 	}
 };
 
+/*
+* Where the time and the bytes of one encode went. The stage times are wall clock milliseconds: import is the RGB to YUV/ARGB conversion,
+* preprocess the optional blend/crop/rescale, encode is WebPEncode minus the time spent in the output writer, output is that writer time
+* plus the final copy into the caller's vector. The bitstream figures come from libwebp's WebPAuxStats.
+*/
+struct WebpEncodeStats
+{
+	double												f_import_ms;
+
+	double												f_preprocess_ms;
+
+	double												f_encode_ms;
+
+	double												f_output_ms;
+
+	double												f_total_ms;
+
+	size_t												n_coded_size;
+
+	bool												b_lossless;
+
+	float												f_psnr[5];					// Y, U, V, All, Alpha in dB (lossy only)
+
+	int													n_header_bytes[2];			// header and mode partition #0
+
+	int													n_residual_bytes[3][4];		// DC/AC/UV coefficient bytes of each segment
+
+	int													n_segment_size[4];			// macroblocks per segment
+
+	int													n_segment_quant[4];
+
+	int													n_block_count[3];			// intra4, intra16 and skipped macroblocks
+
+	int													n_alpha_data_size;
+
+	unsigned int										n_lossless_features;		// bit0: predictor, bit1: cross-color, bit2: subtract-green, bit3: color indexing
+
+	int													n_lossless_hdr_size;
+
+	int													n_lossless_data_size;
+
+	int													n_palette_size;
+
+	int													n_cache_bits;
+
+	size_t												n_estimated_plane_bytes;	// computed from the picture size, not measured: input planes, libwebp's main working copy and the output
+
+	WebpEncodeStats()
+	{
+		memset(this, 0, sizeof(*this));
+	}
+};
+
+/*
+* One image of a batch, n_stride is the size of a row in bytes (0 means width * n_bytes_per_pixel)
+*/
+struct WebpBatchInput
+{
+	const uint8_t*										p_image;
+
+	unsigned int										n_width;
+
+	unsigned int										n_height;
+
+	unsigned int										n_stride;
+
+	unsigned int										n_bytes_per_pixel;
+
+	WebpBatchInput()
+	{
+		p_image = NULL;
+
+		n_width = n_height = n_stride = n_bytes_per_pixel = 0;
+	}
+};
+
+/*
+* Result of one image of a batch, a failed item doesn't stop the others
+*/
+struct WebpBatchOutput
+{
+	std::vector<char>									out_img;
+
+	size_t												output_size;
+
+	bool												b_success;
+
+	int													n_error_code;		// VP8_ENC_ERROR_* of a failed item, from the import or from libwebp
+
+	float												f_psnr;				// achieved PSNR (dB), only measured in rate control mode
+
+	WebpEncodeStats										stats;				// filled when b_collect_stats is set
+
+	WebpBatchOutput()
+	{
+		output_size = 0;
+
+		f_psnr = 0;
+
+		b_success = false;
+
+		n_error_code = 0;
+	}
+};
+
+/*
+* Caller owned destination of EncodeImageInto. When the bitstream doesn't fit, ptr_grow is asked for a buffer of at least n_required bytes that
+* keeps the n_size bytes already written (a realloc does), and returns it with its capacity. Without a callback, or if it returns NULL, the encode fails.
+*/
+struct WebpOutputBuffer
+{
+	uint8_t*											p_data;
+
+	size_t												n_capacity;
+
+	size_t												n_size;				// bytes of bitstream written so far
+
+	uint8_t*											(*ptr_grow)( _In_ void* p_user_data, _In_ uint8_t* p_data, _In_ size_t n_size, _In_ size_t n_required, _Out_ size_t* n_new_capacity );
+
+	void*												p_user_data;
+
+	WebpOutputBuffer()
+	{
+		p_data = NULL;
+
+		n_capacity = n_size = 0;
+
+		ptr_grow = NULL;
+
+		p_user_data = NULL;
+	}
+};
+
+enum WEBP_YUV_LAYOUT { WEBP_YUV_LAYOUT_I420, WEBP_YUV_LAYOUT_NV12 };
+
+/*
+* Caller owned planes of a 4:2:0 frame, e.g. straight out of a video decoder. For I420 p_u and p_v are separate planes, for NV12 p_u is the
+* interleaved UV plane and p_v is unused. p_a is an optional full resolution alpha plane, only kept when b_retain_alpha is set.
+* The planes are read only. They are encoded in place, except that with alpha they are copied first unless the config asks for exact encoding,
+* since libwebp rewrites the colour of fully transparent pixels.
+*/
+struct WebpYUVPlanes
+{
+	WEBP_YUV_LAYOUT										n_layout;
+
+	unsigned int										n_width;
+
+	unsigned int										n_height;
+
+	const uint8_t*										p_y;
+
+	const uint8_t*										p_u;
+
+	const uint8_t*										p_v;
+
+	const uint8_t*										p_a;
+
+	unsigned int										n_y_stride;		// bytes between two rows of each plane
+
+	unsigned int										n_uv_stride;
+
+	unsigned int										n_a_stride;
+
+	WebpYUVPlanes()
+	{
+		n_layout = WEBP_YUV_LAYOUT_I420;
+
+		n_width = n_height = 0;
+
+		p_y = p_u = p_v = p_a = NULL;
+
+		n_y_stride = n_uv_stride = n_a_stride = 0;
+	}
+};
+
+/*
+* Outcome of the last rate controlled encode: the budget it was given and what libwebp's search achieved
+*/
+struct WebpRateControlResult
+{
+	size_t												n_target_size;		// 0 when the target was a PSNR
+
+	float												f_target_psnr;
+
+	size_t												n_coded_size;
+
+	float												f_psnr;				// all channels, as reported by WebPAuxStats
+
+	float												f_psnr_alpha;
+
+	bool												b_target_met;
+
+	WebpRateControlResult()
+	{
+		n_target_size = n_coded_size = 0;
+
+		f_target_psnr = f_psnr = f_psnr_alpha = 0;
+
+		b_target_met = false;
+	}
+};
+
+enum WEBP_QUALITY_METRIC { WEBP_QUALITY_METRIC_PSNR, WEBP_QUALITY_METRIC_SSIM };
+
+/*
+* Floor for EncodeToQualityFloor. f_min_value is in dB for PSNR and between 0 and 1 for SSIM, both are measured on the decoded RGBA against the
+* source. n_parallel_probes encodes are run per search round, 0 means one per pool thread.
+*/
+struct WebpQualityFloor
+{
+	WEBP_QUALITY_METRIC									n_metric;
+
+	float												f_min_value;
+
+	float												f_min_quality;		// search range of the lossy quality
+
+	float												f_max_quality;
+
+	float												f_tolerance;		// the search stops once the range is narrower than this
+
+	unsigned int										n_parallel_probes;
+
+	bool												b_try_lossless;		// lossless competes with the lossy candidates on size
+
+	WebpQualityFloor()
+	{
+		n_metric = WEBP_QUALITY_METRIC_PSNR;
+
+		f_min_value = 40;
+
+		f_min_quality = 0;
+
+		f_max_quality = 100;
+
+		f_tolerance = 1;
+
+		n_parallel_probes = 0;
+
+		b_try_lossless = false;
+	}
+};
+
+struct WebpQualitySearchResult
+{
+	float												f_quality;
+
+	bool												b_lossless;
+
+	float												f_metric;			// PSNR in dB, or SSIM between 0 and 1
+
+	size_t												n_size;
+
+	unsigned int										n_probes;			// encodes done by the search
+
+	unsigned int										n_rounds;			// parallel rounds, the latency is about n_rounds encodes
+
+	bool												b_floor_met;
+
+	WebpQualitySearchResult()
+	{
+		f_quality = f_metric = 0;
+
+		b_lossless = b_floor_met = false;
+
+		n_size = 0;
+
+		n_probes = n_rounds = 0;
+	}
+};
+
+class WebpThreadPool;
+
+class WebpOutputSink;
+
+struct WebpEncoderWorker;
+
 class WebpEncoder
 {
 
@@ -82,25 +418,64 @@ public:
 
 				WebpEncoder												( );
 
+				WebpEncoder												( const WebpEncoder &other );	// clones the validated configuration of 'other'
+
 				~WebpEncoder											( );
 
+	WebpEncoder&	operator=											( const WebpEncoder &other );
+
 public:
 
 	bool		InitEncoder												( ImageCompressionProperties	&config );
+
+	bool		IsInitialized											( ) const;
+
+	static WEBP_KERNEL_ISA	GetInstructionSet							( );	// SIMD path actually in use
+
 				
 
 public:
 
-	bool		SetPixelFormat											( IMG_PIXEL_FORMATS pixel_format );
+	bool		SetPixelFormat											( IMG_PIXEL_FORMATS pixel_format );	// false for the decoder only formats
 
 	bool		EncodeImage												( _In_ uint8_t* in_image, _In_ unsigned int width, _In_ unsigned int height, _In_ unsigned int	n_bytes_per_pixel, _In_ float f_quality_factor, _Inout_ std::vector<char> &out_img, _Inout_ size_t &output_size );
 
 	bool		EncodeImage												( _In_ uint8_t* in_image, _In_ unsigned int width, _In_ unsigned int height, _In_ unsigned int	n_bytes_per_pixel, _Inout_ std::vector<char> &out_img, _Inout_ size_t &output_size );
 
+	bool		EncodeImageWithStride									( _In_ const uint8_t* in_image, _In_ unsigned int width, _In_ unsigned int height, _In_ unsigned int n_bytes_per_pixel, _In_ unsigned int n_stride, _Inout_ std::vector<char> &out_img, _Inout_ size_t &output_size );	// n_stride is the size of a row in bytes
+
 	bool		EncodeImageAndWriteToFile								( _In_ uint8_t* in_image, _In_ unsigned int width, _In_ unsigned int height, _In_ unsigned int	n_bytes_per_pixel, _In_ const char* out_file );
 
 	bool		EncodeImageFromTestFile									( _In_ const char *img_file, _Inout_ std::vector<char> &out_img, _Inout_ size_t &output_size );
 
+	bool		EncodeBatch												( _In_ const WebpBatchInput *inputs, _In_ size_t n_count, _Inout_ WebpBatchOutput *outputs );	// false if any of the items failed
+
+	bool		EncodeImageInto											( _In_ const uint8_t* in_image, _In_ unsigned int width, _In_ unsigned int height, _In_ unsigned int n_bytes_per_pixel, _Inout_ WebpOutputBuffer &out_buffer, _In_ unsigned int n_stride = 0 );
+
+	bool		EncodeImageToView										( _In_ const uint8_t* in_image, _In_ unsigned int width, _In_ unsigned int height, _In_ unsigned int n_bytes_per_pixel, _Inout_ const uint8_t* &out_data, _Inout_ size_t &output_size, _In_ unsigned int n_stride = 0 );	// out_data stays valid until the next encode on this encoder
+
+	bool		EncodeImageToSink										( _In_ const uint8_t* in_image, _In_ unsigned int width, _In_ unsigned int height, _In_ unsigned int n_bytes_per_pixel, _Inout_ WebpOutputSink &sink, _In_ unsigned int n_stride = 0 );	// Finish on success, Abort on failure
+
+	bool		EncodeYUV												( _In_ const WebpYUVPlanes &planes, _Inout_ std::vector<char> &out_img, _Inout_ size_t &output_size );	// no RGB to YUV conversion, I420 planes aren't even copied
+
+	bool		EncodeYUVInto											( _In_ const WebpYUVPlanes &planes, _Inout_ WebpOutputBuffer &out_buffer );
+
+	bool		EncodeYUVToSink											( _In_ const WebpYUVPlanes &planes, _Inout_ WebpOutputSink &sink );	// Finish on success, Abort on failure
+
+	bool		EncodeToQualityFloor									( _In_ const uint8_t* in_image, _In_ unsigned int width, _In_ unsigned int height, _In_ unsigned int n_bytes_per_pixel, _In_ const WebpQualityFloor &quality_floor, _Inout_ std::vector<char> &out_img, _Inout_ size_t &output_size, _Inout_ WebpQualitySearchResult *p_result = NULL, _In_ unsigned int n_stride = 0 );	// false if even the best candidate misses the floor, out_img still gets it
+
+	bool		GetLastEncodeStats										( _Inout_ WebpEncodeStats &stats ) const;	// false unless b_collect_stats is set and an encode succeeded
+
+	bool		GetLastRateControlResult								( _Inout_ WebpRateControlResult &result ) const;	// false unless rate control is on and an encode succeeded
+
+	bool		GetPicturePoolStats										( _Inout_ WebpPicturePoolStats &stats ) const;	// false if the pool is disabled or not used yet
+
+	static unsigned int	GetDefaultStride								( _In_ IMG_PIXEL_FORMATS pixel_format, _In_ unsigned int width, _In_ unsigned int n_bytes_per_pixel );	// row size used when n_stride is 0
+
+	static void	SetInstructionSetCeiling								( _In_ WEBP_KERNEL_ISA n_ceiling );	// process wide and shared with the decoder, call it once at startup
+
+	static unsigned int	GetInputBytesPerPixel							( _In_ IMG_PIXEL_FORMATS pixel_format );	// of the Y plane for planar YUV, 0 for the decoder only formats
+
 protected:
 
 	bool																b_scale;
@@ -117,10 +492,72 @@ protected:
 
 	uint32_t															background_color; // used if bleand alpha is set
 
+private:
+
+	friend class WebpAnimationEncoder;	// imports the frames and encodes them with the config of its own encoder
+
+	void		ReleaseWorkers											( );
+
+	bool		EncodeBatchItem											( _In_ const WebpBatchInput &input, _Inout_ WebpBatchOutput &output, _Inout_ WebpEncoderWorker &worker );
+
+	WebpThreadPool*	GetThreadPool										( );
+
+#ifdef _USE_WEBP_
+
+	WebpPicturePool*	GetPicturePool									( );
+
+	WebPPicture*	AcquirePooledPicture								( _In_ unsigned int width, _In_ unsigned int height );
+
+	bool		ImportPicture											( _Inout_ WebPPicture *picture, _In_ const uint8_t* in_image, _In_ int stride, _In_ unsigned int n_bytes_per_pixel, _In_ bool b_allow_parallel, _In_ bool b_pooled, _Inout_ std::vector<uint8_t> *p_plane_scratch = NULL );	// on failure picture->error_code says why, e.g. VP8_ENC_ERROR_INVALID_CONFIGURATION when the stride or pixel size don't fit the pixel format. NULL scratch uses m_plane_scratch
+
+	bool		ImportPictureParallel									( _Inout_ WebPPicture *picture, _In_ const uint8_t* in_image, _In_ int stride, _In_ int (*ptr_import)(WebPPicture*, const uint8_t*, int) );
+
+	bool		AttachYUVPlanes											( _Inout_ WebPPicture *picture, _In_ const WebpYUVPlanes &planes, _Inout_ std::vector<uint8_t> &scratch );
+
+	bool		EncodePicture											( _Inout_ WebPPicture &picture, _Inout_ WebpEncodeStats *p_stats, _Inout_ WebpRateControlResult *p_rate_control );
+
+	bool		EncodeToWriter											( _In_ const uint8_t* in_image, _In_ unsigned int width, _In_ unsigned int height, _In_ unsigned int n_bytes_per_pixel, _In_ int stride, _In_ WebPWriterFunction writer, _In_ void* custom_ptr );
+
+	bool		EncodeYUVToWriter										( _In_ const WebpYUVPlanes &planes, _In_ WebPWriterFunction writer, _In_ void* custom_ptr );
+
+#endif
+
 
 private:
 
 	IMG_PIXEL_FORMATS													n_pixel_format;
 
+	bool																b_config_valid;	// set once InitEncoder has validated m_webp_config
+
+	bool																b_keep_alpha;	// from b_retain_alpha, RGBA/BGRA/ARGB inputs are treated as RGBX/BGRX/XRGB otherwise
+
+	unsigned int														n_worker_threads;	// size of the pool, from b_use_parallel_processing and n_thread_count
+
+	WebpThreadPool*														m_thread_pool;		// created on first use, never shared between encoders
+
+	std::vector<WebpEncoderWorker*>										m_workers;			// picture and output writer reused by each pool worker
+
+	size_t																n_picture_pool_bytes;	// 0 when the picture pool is disabled
+
+	WebpPicturePool*													m_picture_pool;		// created on first use, shared by the batch workers of this encoder
+
+	bool																b_rate_control;		// target_size or target_PSNR set in m_webp_config
+
+	WebpRateControlResult												m_last_rate_control;	// filled by the single image encodes, not by EncodeBatch
+
+	bool																b_collect_stats;
+
+	WebpEncodeStats														m_last_stats;		// filled by the single image encodes, batch items carry their own
+
+	std::vector<uint8_t>												m_plane_scratch;	// NV12 chroma split in U and V, or all planes of a YUVA frame libwebp would rewrite; single image encodes only
+
+#ifdef _USE_WEBP_
+
+	WebPConfig															m_webp_config;	// per instance, so encoders on different threads don't share settings
+
+	WebPMemoryWriter													m_output_arena;	// backs the views returned by EncodeImageToView
+
+#endif
+
 
 };
\ No newline at end of file
@@ -0,0 +1,494 @@
+/********************************************************************************************************************************************************************************************
+* FileName   : WebPAnimationDecoder.cpp
+* Description: Animated WebP decoding with a keyframe table and a single reused canvas
+* Date		 : 17/10/2026
+* Author     : Ramesh Kumar K
+*
+********************************************************************************************************************************************************************************************/
+
+# include "WebPAnimationDecoder.h"
+# include "WebPMetrics.h"
+# include <string.h>
+
+#ifdef _USE_WEBP_
+# include "webp/decode.h"
+# include "webp/demux.h"
+#endif
+
+#define TRACE(...)
+
+/*
+* Constructor
+*/
+WebpAnimationDecoder::WebpAnimationDecoder()
+{
+	m_demux								= NULL;
+	n_pixel_format						= PIXEL_FORMAT_RGBA;
+	n_canvas_width						= 0;
+	n_canvas_height						= 0;
+	n_loop_count						= 0;
+	n_background_color					= 0;
+	n_next_frame						= 0;
+	n_canvas_frame						= -1;
+}
+
+WebpAnimationDecoder::~WebpAnimationDecoder()
+{
+	Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Open builds the frame table from the demuxer. A frame is a keyframe under the same rules as libwebp's anim_decode.c: the first frame, a full
+// canvas frame which doesn't blend with what is under it, or a frame after one whose rectangle was cleared and which covered the canvas or was a
+// keyframe itself, since the canvas is then entirely transparent.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WebpAnimationDecoder::Open( _In_ const uint8_t* data, _In_ size_t data_size, _In_ IMG_PIXEL_FORMATS pixel_format )
+{
+	Close();
+
+#ifdef _USE_WEBP_
+
+	WebPData			webp_data;
+	WebPIterator		iter;
+
+	int					n_timestamp	= 0;
+	int					n_frames	= 0;
+
+	if (!data || (pixel_format != PIXEL_FORMAT_RGBA && pixel_format != PIXEL_FORMAT_BGRA && pixel_format != PIXEL_FORMAT_RGBA_PREMULTIPLIED))
+	{
+		return false;
+	}
+
+	webp_data.bytes		= data;
+	webp_data.size		= data_size;
+
+	m_demux				= WebPDemux(&webp_data);
+
+	if (!m_demux)
+	{
+		TRACE(_T("Error! Not a complete WebP file\n"));
+		return false;
+	}
+
+	n_pixel_format		= pixel_format;
+	n_canvas_width		= (int)WebPDemuxGetI(m_demux, WEBP_FF_CANVAS_WIDTH);
+	n_canvas_height		= (int)WebPDemuxGetI(m_demux, WEBP_FF_CANVAS_HEIGHT);
+	n_loop_count		= (int)WebPDemuxGetI(m_demux, WEBP_FF_LOOP_COUNT);
+	n_background_color	= WebPDemuxGetI(m_demux, WEBP_FF_BACKGROUND_COLOR);
+	n_frames			= (int)WebPDemuxGetI(m_demux, WEBP_FF_FRAME_COUNT);
+
+	if (n_canvas_width <= 0 || n_canvas_height <= 0 || n_frames <= 0)
+	{
+		Close();
+		return false;
+	}
+
+	m_frames.reserve(n_frames);
+	m_payloads.reserve(n_frames);
+
+	for (int i = 1; i <= n_frames; ++i)
+	{
+		if (!WebPDemuxGetFrame(m_demux, i, &iter))
+		{
+			Close();
+			return false;
+		}
+
+		WebpAnimationFrameInfo		info;
+		Payload						payload;
+
+		info.n_x_offset				= iter.x_offset;
+		info.n_y_offset				= iter.y_offset;
+		info.n_width				= iter.width;
+		info.n_height				= iter.height;
+		info.n_timestamp_ms			= n_timestamp;
+		info.n_duration_ms			= iter.duration;
+		info.b_has_alpha			= iter.has_alpha != 0;
+		info.b_blend				= iter.blend_method == WEBP_MUX_BLEND;
+		info.b_dispose_to_background	= iter.dispose_method == WEBP_MUX_DISPOSE_BACKGROUND;
+
+		payload.data				= iter.fragment.bytes;
+		payload.n_size				= iter.fragment.size;
+
+		WebPDemuxReleaseIterator(&iter);
+
+		const bool b_full_canvas	= info.n_x_offset == 0 && info.n_y_offset == 0 && info.n_width == n_canvas_width && info.n_height == n_canvas_height;
+
+		if (m_frames.empty())
+		{
+			info.b_keyframe			= true;
+		}
+		else if ((!info.b_has_alpha || !info.b_blend) && b_full_canvas)
+		{
+			info.b_keyframe			= true;
+		}
+		else
+		{
+			const WebpAnimationFrameInfo &prev = m_frames.back();
+
+			const bool b_prev_full	= prev.n_x_offset == 0 && prev.n_y_offset == 0 && prev.n_width == n_canvas_width && prev.n_height == n_canvas_height;
+
+			info.b_keyframe			= prev.b_dispose_to_background && (b_prev_full || prev.b_keyframe);
+		}
+
+		n_timestamp					+= info.n_duration_ms;
+
+		m_frames.push_back(info);
+		m_payloads.push_back(payload);
+	}
+
+	m_canvas.resize((size_t)n_canvas_width * n_canvas_height * 4);
+
+	return true;
+
+#else
+
+	(void)data; (void)data_size; (void)pixel_format;
+
+	return false;
+
+#endif
+}
+
+void WebpAnimationDecoder::Close( )
+{
+#ifdef _USE_WEBP_
+	if (m_demux)
+	{
+		WebPDemuxDelete(m_demux);
+	}
+#endif
+
+	m_demux				= NULL;
+	n_canvas_width		= 0;
+	n_canvas_height		= 0;
+	n_loop_count		= 0;
+	n_background_color	= 0;
+	n_next_frame		= 0;
+	n_canvas_frame		= -1;
+
+	m_frames.clear();
+	m_payloads.clear();
+
+	std::vector<uint8_t>().swap(m_canvas);
+	std::vector<uint8_t>().swap(m_frame);
+}
+
+int WebpAnimationDecoder::GetFrameCount( ) const
+{
+	return (int)m_frames.size();
+}
+
+int WebpAnimationDecoder::GetCanvasWidth( ) const
+{
+	return n_canvas_width;
+}
+
+int WebpAnimationDecoder::GetCanvasHeight( ) const
+{
+	return n_canvas_height;
+}
+
+int WebpAnimationDecoder::GetLoopCount( ) const
+{
+	return n_loop_count;
+}
+
+uint32_t WebpAnimationDecoder::GetBackgroundColor( ) const
+{
+	return n_background_color;
+}
+
+int WebpAnimationDecoder::GetDuration( ) const
+{
+	return m_frames.empty() ? 0 : m_frames.back().n_timestamp_ms + m_frames.back().n_duration_ms;
+}
+
+const WebpAnimationFrameInfo* WebpAnimationDecoder::GetFrameInfo( _In_ int n_frame ) const
+{
+	return (n_frame >= 0 && n_frame < (int)m_frames.size()) ? &m_frames[n_frame] : NULL;
+}
+
+/*
+* Binary search on the start times, before the start is the first frame and past the end the last one
+*/
+int WebpAnimationDecoder::FindFrame( _In_ int n_timestamp_ms ) const
+{
+	int n_low	= 0;
+	int n_high	= (int)m_frames.size() - 1;
+
+	if (n_high < 0)
+	{
+		return -1;
+	}
+
+	while (n_low < n_high)
+	{
+		const int n_mid = (n_low + n_high + 1) / 2;
+
+		if (m_frames[n_mid].n_timestamp_ms <= n_timestamp_ms)
+		{
+			n_low = n_mid;
+		}
+		else
+		{
+			n_high = n_mid - 1;
+		}
+	}
+
+	return n_low;
+}
+
+int WebpAnimationDecoder::FindKeyframe( _In_ int n_frame ) const
+{
+	if (n_frame < 0 || n_frame >= (int)m_frames.size())
+	{
+		return -1;
+	}
+
+	while (n_frame > 0 && !m_frames[n_frame].b_keyframe)
+	{
+		--n_frame;
+	}
+
+	return n_frame;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Iteration and seeking
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WebpAnimationDecoder::GetNextFrame( _Inout_ const uint8_t** canvas, _Inout_ int &n_timestamp_ms )
+{
+	if (!HasMoreFrames() || !DecodeFrame(n_next_frame))
+	{
+		return false;
+	}
+
+	*canvas			= &m_canvas[0];
+	n_timestamp_ms	= m_frames[n_next_frame].n_timestamp_ms;
+
+	++n_next_frame;
+
+	return true;
+}
+
+bool WebpAnimationDecoder::HasMoreFrames( ) const
+{
+	return n_next_frame < (int)m_frames.size();
+}
+
+void WebpAnimationDecoder::Reset( )
+{
+	n_next_frame = 0;
+}
+
+bool WebpAnimationDecoder::SeekToKeyframe( _In_ int n_timestamp_ms )
+{
+	const int n_keyframe = FindKeyframe(FindFrame(n_timestamp_ms));
+
+	if (n_keyframe < 0)
+	{
+		return false;
+	}
+
+	n_next_frame = n_keyframe;
+
+	return true;
+}
+
+bool WebpAnimationDecoder::DecodeFrameAt( _In_ int n_timestamp_ms, _Inout_ const uint8_t** canvas, _Inout_ int &n_frame )
+{
+	const int	n_target	= FindFrame(n_timestamp_ms);
+	const int	n_keyframe	= FindKeyframe(n_target);
+
+	if (n_target < 0)
+	{
+		return false;
+	}
+
+	// the canvas already holds a frame between the keyframe and the target, carry on from it
+
+	int			n_first		= (n_canvas_frame >= n_keyframe && n_canvas_frame <= n_target) ? n_canvas_frame + 1 : n_keyframe;
+
+	for (int i = n_first; i <= n_target; ++i)
+	{
+		if (!DecodeFrame(i))
+		{
+			return false;
+		}
+	}
+
+	*canvas			= &m_canvas[0];
+	n_frame			= n_target;
+	n_next_frame	= n_target + 1;
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Compositing. Frames which don't blend, and keyframes whose canvas is transparent anyway, are decoded straight into their rectangle of the
+// canvas; frames which blend go through m_frame and are blended over the canvas row by row.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WebpAnimationDecoder::DecodeFrame( _In_ int n_frame )
+{
+#ifdef _USE_WEBP_
+
+	const WebpAnimationFrameInfo		&info = m_frames[n_frame];
+
+	WebPDecoderConfig					config;
+
+	if (!info.b_keyframe && n_canvas_frame != n_frame - 1)
+	{
+		// the canvas doesn't hold the previous frame, e.g. after SeekToKeyframe moved forward: rebuild it from the keyframe
+
+		const int n_keyframe = FindKeyframe(n_frame);
+
+		for (int i = n_keyframe; i < n_frame; ++i)
+		{
+			if (!DecodeFrame(i))
+			{
+				return false;
+			}
+		}
+	}
+
+	if (!WebPInitDecoderConfig(&config))
+	{
+		return false;
+	}
+
+	WEBP_METRICS_START(n_metrics_start);
+
+	if (info.b_keyframe)
+	{
+		memset(&m_canvas[0], 0, m_canvas.size());
+	}
+	else if (m_frames[n_frame - 1].b_dispose_to_background)
+	{
+		const WebpAnimationFrameInfo &prev = m_frames[n_frame - 1];
+
+		ClearRect(prev.n_x_offset, prev.n_y_offset, prev.n_width, prev.n_height);
+	}
+
+	const bool							b_blend			= info.b_blend && info.b_has_alpha && !info.b_keyframe;
+	const int							n_canvas_stride	= n_canvas_width * 4;
+
+	config.output.colorspace			= (n_pixel_format == PIXEL_FORMAT_BGRA) ? MODE_BGRA : (n_pixel_format == PIXEL_FORMAT_RGBA_PREMULTIPLIED) ? MODE_rgbA : MODE_RGBA;
+	config.output.is_external_memory	= 1;
+
+	if (b_blend)
+	{
+		m_frame.resize((size_t)info.n_width * info.n_height * 4);
+
+		config.output.u.RGBA.rgba		= &m_frame[0];
+		config.output.u.RGBA.stride		= info.n_width * 4;
+		config.output.u.RGBA.size		= m_frame.size();
+	}
+	else
+	{
+		config.output.u.RGBA.rgba		= &m_canvas[(size_t)info.n_y_offset * n_canvas_stride + (size_t)info.n_x_offset * 4];
+		config.output.u.RGBA.stride		= n_canvas_stride;
+		config.output.u.RGBA.size		= m_canvas.size() - ((size_t)info.n_y_offset * n_canvas_stride + (size_t)info.n_x_offset * 4);
+	}
+
+	const VP8StatusCode n_status = WebPDecode(m_payloads[n_frame].data, m_payloads[n_frame].n_size, &config);
+
+	WEBP_METRICS_RECORD(WEBP_METRIC_OP_DECODE, n_metrics_start, n_status == VP8_STATUS_OK ? (uint64_t)info.n_width * info.n_height : 0, m_payloads[n_frame].n_size,
+		n_status == VP8_STATUS_OK ? (uint64_t)info.n_width * info.n_height * 4 : 0, n_status);
+
+	if (n_status != VP8_STATUS_OK)
+	{
+		TRACE(_T("Error! Frame %d failed to decode with status %d\n"), n_frame, (int)n_status);
+
+		n_canvas_frame = -1;
+		return false;
+	}
+
+	if (b_blend)
+	{
+		BlendFrame(info);
+	}
+
+	n_canvas_frame = n_frame;
+
+	return true;
+
+#else
+
+	(void)n_frame;
+
+	return false;
+
+#endif
+}
+
+void WebpAnimationDecoder::ClearRect( _In_ int x, _In_ int y, _In_ int width, _In_ int height )
+{
+	for (int row = y; row < y + height; ++row)
+	{
+		memset(&m_canvas[((size_t)row * n_canvas_width + x) * 4], 0, (size_t)width * 4);
+	}
+}
+
+/*
+* Source over destination, the alpha is the last byte in all three canvas layouts. The straight alpha formula is libwebp's own
+* BlendPixelNonPremult, so the canvas matches WebPAnimDecoder's.
+*/
+void WebpAnimationDecoder::BlendFrame( _In_ const WebpAnimationFrameInfo &info )
+{
+	const bool b_premultiplied = (n_pixel_format == PIXEL_FORMAT_RGBA_PREMULTIPLIED);
+
+	for (int y = 0; y < info.n_height; ++y)
+	{
+		const uint8_t	*src = &m_frame[(size_t)y * info.n_width * 4];
+		uint8_t			*dst = &m_canvas[((size_t)(info.n_y_offset + y) * n_canvas_width + info.n_x_offset) * 4];
+
+		for (int x = 0; x < info.n_width; ++x, src += 4, dst += 4)
+		{
+			const uint32_t src_a = src[3];
+
+			if (src_a == 0)
+			{
+				continue;
+			}
+
+			if (src_a == 255)
+			{
+				memcpy(dst, src, 4);
+				continue;
+			}
+
+			if (b_premultiplied)
+			{
+				const uint32_t n_scale = 256 - src_a;
+
+				for (int c = 0; c < 4; ++c)
+				{
+					dst[c] = (uint8_t)(src[c] + ((dst[c] * n_scale) >> 8));
+				}
+
+				continue;
+			}
+
+			const uint32_t dst_a	= (dst[3] * (256 - src_a)) >> 8;
+			const uint32_t blend_a	= src_a + dst_a;
+			const uint32_t n_scale	= (1u << 24) / blend_a;
+
+			for (int c = 0; c < 3; ++c)
+			{
+				dst[c] = (uint8_t)(((src[c] * src_a + dst[c] * dst_a) * n_scale) >> 24);
+			}
+
+			dst[3] = (uint8_t)blend_a;
+		}
+	}
+}
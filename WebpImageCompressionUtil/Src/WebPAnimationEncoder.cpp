@@ -0,0 +1,501 @@
+/********************************************************************************************************************************************************************************************
+* FileName   : WebPAnimationEncoder.cpp
+* Description: Animated WebP encoding on WebPAnimEncoder, optionally pipelined on a worker thread
+* Date		 : 17/10/2026
+* Author     : Ramesh Kumar K
+*
+********************************************************************************************************************************************************************************************/
+
+# include "WebPAnimationEncoder.h"
+# include "WebPMetrics.h"
+# include <limits.h>
+# include <string.h>
+
+#ifdef _USE_WEBP_
+# include "webp/encode.h"
+# include "webp/mux.h"
+#endif
+
+#define TRACE(...)
+
+/*
+* A converted frame on its way to WebPAnimEncoderAdd. The picture holds its own ARGB copy of the pixels, so the caller's buffer isn't
+* needed once the frame is queued.
+*/
+struct WebpAnimationFrame
+{
+#ifdef _USE_WEBP_
+	WebPPicture															picture;
+
+	WebPConfig															config;
+#endif
+
+	int																	n_timestamp_ms;
+};
+
+static void ReleaseFrame( WebpAnimationFrame *frame )
+{
+#ifdef _USE_WEBP_
+	WebPPictureFree(&frame->picture);
+#endif
+
+	delete frame;
+}
+
+/*
+* Constructor
+*/
+WebpAnimationEncoder::WebpAnimationEncoder()
+{
+	b_config_valid						= false;
+	m_anim_encoder						= NULL;
+	n_width								= 0;
+	n_height							= 0;
+	n_frame_count						= 0;
+	n_last_timestamp					= 0;
+	b_stop								= false;
+	b_failed							= false;
+}
+
+WebpAnimationEncoder::~WebpAnimationEncoder()
+{
+	Abort();
+}
+
+bool WebpAnimationEncoder::InitEncoder( _In_ ImageCompressionProperties &config, _In_ const WebpAnimationEncodeOptions &anim_options )
+{
+	Abort();
+
+	b_config_valid = false;
+
+	if (!m_encoder.SetPixelFormat(config.pixel_format) || !m_encoder.InitEncoder(config))
+	{
+		return false;
+	}
+
+	m_options		= anim_options;
+	b_config_valid	= true;
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// One animation: Begin, AddFrame for every frame, then Finish or Abort
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WebpAnimationEncoder::Begin( _In_ unsigned int width, _In_ unsigned int height )
+{
+	Abort();
+
+	SetError(NULL);
+
+#ifdef _USE_WEBP_
+
+	WebPAnimEncoderOptions		options;
+
+	if (!b_config_valid || width == 0 || height == 0 || width > WEBP_MAX_DIMENSION || height > WEBP_MAX_DIMENSION)
+	{
+		return false;
+	}
+
+	if (!WebPAnimEncoderOptionsInit(&options))
+	{
+		return false;
+	}
+
+	options.anim_params.loop_count	= m_options.n_loop_count;
+	options.anim_params.bgcolor		= m_options.n_background_color;
+	options.minimize_size			= m_options.b_minimize_size;
+	options.allow_mixed				= m_options.b_allow_mixed;
+	options.verbose					= 0;
+
+	if (m_options.n_kmin == 0 && m_options.n_kmax == 0)
+	{
+		// gif2webp's defaults, lossless frames are costlier to restart from scratch so they get keyframes less often
+
+		const bool b_lossless		= m_encoder.m_webp_config.lossless != 0;
+
+		options.kmin				= b_lossless ? 9 : 3;
+		options.kmax				= b_lossless ? 17 : 5;
+	}
+	else
+	{
+		options.kmin				= m_options.n_kmin;
+		options.kmax				= m_options.n_kmax;
+	}
+
+	m_anim_encoder					= WebPAnimEncoderNew((int)width, (int)height, &options);
+
+	if (!m_anim_encoder)
+	{
+		return false;
+	}
+
+	n_width							= width;
+	n_height						= height;
+	n_frame_count					= 0;
+	n_last_timestamp				= 0;
+	b_failed						= false;
+	b_stop							= false;
+
+	if (m_options.b_pipelined)
+	{
+		m_worker = std::thread(&WebpAnimationEncoder::WorkerLoop, this);
+	}
+
+	return true;
+
+#else
+
+	(void)width; (void)height;
+
+	return false;
+
+#endif
+}
+
+bool WebpAnimationEncoder::AddFrame( _In_ const uint8_t* in_image, _In_ int n_timestamp_ms, _In_ unsigned int n_stride )
+{
+	return QueueFrame(in_image, n_timestamp_ms, n_stride, false, false, 0);
+}
+
+bool WebpAnimationEncoder::AddFrame( _In_ const uint8_t* in_image, _In_ int n_timestamp_ms, _In_ bool b_lossless, _In_ float f_quality_factor, _In_ unsigned int n_stride )
+{
+	return QueueFrame(in_image, n_timestamp_ms, n_stride, true, b_lossless, f_quality_factor);
+}
+
+bool WebpAnimationEncoder::Finish( _In_ int n_end_timestamp_ms, _Inout_ std::vector<char> &out_img, _Inout_ size_t &output_size )
+{
+#ifdef _USE_WEBP_
+
+	WebPData					webp_data;
+
+	WebPDataInit(&webp_data);
+
+	if (!m_anim_encoder || n_frame_count == 0 || n_end_timestamp_ms < n_last_timestamp)
+	{
+		return false;
+	}
+
+	StopWorker();		// lets the worker drain the queue first
+
+	if (b_failed)
+	{
+		goto Error;
+	}
+
+	if (!WebPAnimEncoderAdd(m_anim_encoder, NULL, n_end_timestamp_ms, NULL) || !WebPAnimEncoderAssemble(m_anim_encoder, &webp_data))
+	{
+		SetError(WebPAnimEncoderGetError(m_anim_encoder));
+		goto Error;
+	}
+
+	out_img.assign((const char*)webp_data.bytes, (const char*)webp_data.bytes + webp_data.size);
+
+	output_size = webp_data.size;
+
+	WebPDataClear(&webp_data);
+
+	WebPAnimEncoderDelete(m_anim_encoder);
+
+	m_anim_encoder = NULL;
+
+	return true;
+
+Error:
+
+	TRACE(_T("Error! Animation failed: %hs\n"), m_error.c_str());
+
+	WebPDataClear(&webp_data);
+
+	Abort();
+
+	return false;
+
+#else
+
+	(void)n_end_timestamp_ms; (void)out_img; (void)output_size;
+
+	return false;
+
+#endif
+}
+
+/*
+* Drops the frames still queued and the animation, keeps the error of the failure that led here
+*/
+void WebpAnimationEncoder::Abort( )
+{
+	{
+		std::lock_guard<std::mutex>		lock(m_lock);
+
+		while (!m_queue.empty())
+		{
+			ReleaseFrame(m_queue.front());
+
+			m_queue.pop_front();
+		}
+	}
+
+	StopWorker();
+
+#ifdef _USE_WEBP_
+	if (m_anim_encoder)
+	{
+		WebPAnimEncoderDelete(m_anim_encoder);
+	}
+#endif
+
+	m_anim_encoder	= NULL;
+	n_frame_count	= 0;
+}
+
+int WebpAnimationEncoder::GetFrameCount( ) const
+{
+	return n_frame_count;
+}
+
+std::string WebpAnimationEncoder::GetLastError( ) const
+{
+	std::lock_guard<std::mutex>			lock(m_lock);
+
+	return m_error;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// The frame is converted to ARGB on the caller's thread, with WebpEncoder's importers, because WebPAnimEncoder works on ARGB and would
+// otherwise convert YUV input itself. The copy is what makes the pipeline possible: the caller's buffer is free again when AddFrame returns.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WebpAnimationEncoder::QueueFrame( _In_ const uint8_t* in_image, _In_ int n_timestamp_ms, _In_ unsigned int n_stride, _In_ bool b_override, _In_ bool b_lossless, _In_ float f_quality_factor )
+{
+#ifdef _USE_WEBP_
+
+	WebpAnimationFrame				*frame = NULL;
+
+	const IMG_PIXEL_FORMATS			pixel_format	= m_encoder.n_pixel_format;
+	const unsigned int				stride			= n_stride ? n_stride : WebpEncoder::GetDefaultStride(pixel_format, n_width, WebpEncoder::GetInputBytesPerPixel(pixel_format));
+
+	if (!m_anim_encoder || !in_image || (n_frame_count > 0 && n_timestamp_ms < n_last_timestamp))
+	{
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex>	lock(m_lock);
+
+		if (b_failed)
+		{
+			return false;
+		}
+	}
+
+	frame							= new WebpAnimationFrame;
+	frame->n_timestamp_ms			= n_timestamp_ms;
+	frame->config					= m_encoder.m_webp_config;
+	frame->config.target_size		= 0;		// rate control is per image, the animation encoder would run it on every frame
+	frame->config.target_PSNR		= 0;
+	frame->config.pass				= 1;		// libwebp's default
+
+	if (!WebPPictureInit(&frame->picture))
+	{
+		delete frame;
+		return false;
+	}
+
+	if (b_override)
+	{
+		frame->config.lossless		= b_lossless;
+		frame->config.quality		= f_quality_factor;
+
+		if (!WebPValidateConfig(&frame->config))
+		{
+			goto Error;
+		}
+	}
+
+	frame->picture.use_argb			= true;
+	frame->picture.width			= (int)n_width;
+	frame->picture.height			= (int)n_height;
+
+	if (!m_encoder.ImportPicture(&frame->picture, in_image, (int)stride, WebpEncoder::GetInputBytesPerPixel(pixel_format), false, false))
+	{
+		goto Error;
+	}
+
+	if (!frame->picture.use_argb)
+	{
+		// planar YUV is only attached by the import, the ARGB copy detaches it from the caller's planes
+
+		if (!WebPPictureYUVAToARGB(&frame->picture))
+		{
+			goto Error;
+		}
+
+		frame->picture.y = frame->picture.u = frame->picture.v = frame->picture.a = NULL;
+	}
+
+	n_last_timestamp				= n_timestamp_ms;
+
+	++n_frame_count;
+
+	if (!m_options.b_pipelined)
+	{
+		if (!EncodeFrame(frame))
+		{
+			std::lock_guard<std::mutex>	lock(m_lock);
+
+			b_failed				= true;		// like the worker, Finish must not assemble what is left
+			return false;
+		}
+
+		return true;
+	}
+
+	{
+		std::unique_lock<std::mutex>	lock(m_lock);
+
+		const size_t					n_depth = m_options.n_queue_depth ? m_options.n_queue_depth : 1;
+
+		m_queue_changed.wait(lock, [&]() { return m_queue.size() < n_depth || b_failed; });
+
+		if (b_failed)
+		{
+			lock.unlock();
+
+			ReleaseFrame(frame);
+			return false;
+		}
+
+		m_queue.push_back(frame);
+	}
+
+	m_queue_changed.notify_all();
+
+	return true;
+
+Error:
+
+	ReleaseFrame(frame);
+
+	return false;
+
+#else
+
+	(void)in_image; (void)n_timestamp_ms; (void)n_stride; (void)b_override; (void)b_lossless; (void)f_quality_factor;
+
+	return false;
+
+#endif
+}
+
+/*
+* Frame optimisation and encode of one frame, on the worker thread in pipelined mode. Frame sizes aren't known until the animation is
+* assembled, so the metrics count the time and the pixels but no output bytes.
+*/
+bool WebpAnimationEncoder::EncodeFrame( _Inout_ WebpAnimationFrame *frame )
+{
+#ifdef _USE_WEBP_
+
+	WEBP_METRICS_START(n_metrics_start);
+
+	const bool b_added = WebPAnimEncoderAdd(m_anim_encoder, &frame->picture, frame->n_timestamp_ms, &frame->config) != 0;
+
+	WEBP_METRICS_RECORD(WEBP_METRIC_OP_ENCODE, n_metrics_start, (uint64_t)n_width * n_height, (uint64_t)n_width * n_height * 4, 0, b_added ? 0 : (int)frame->picture.error_code);
+
+	if (!b_added)
+	{
+		SetError(WebPAnimEncoderGetError(m_anim_encoder));
+	}
+
+	ReleaseFrame(frame);
+
+	return b_added;
+
+#else
+
+	ReleaseFrame(frame);
+
+	return false;
+
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Pipelined mode. WebPAnimEncoder compares every frame with the previous one, so the frames are encoded strictly in order by a single
+// worker; the parallelism is between the caller producing and converting frames and the worker encoding them.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WebpAnimationEncoder::WorkerLoop( )
+{
+	for (;;)
+	{
+		WebpAnimationFrame				*frame = NULL;
+
+		bool							b_skip = false;
+
+		{
+			std::unique_lock<std::mutex>	lock(m_lock);
+
+			m_queue_changed.wait(lock, [&]() { return b_stop || !m_queue.empty(); });
+
+			if (m_queue.empty())
+			{
+				return;		// stopped and drained
+			}
+
+			frame			= m_queue.front();
+			b_skip			= b_failed;
+
+			m_queue.pop_front();
+		}
+
+		m_queue_changed.notify_all();		// room for AddFrame
+
+		const bool						b_encoded = !b_skip && EncodeFrame(frame);
+
+		if (b_skip)
+		{
+			ReleaseFrame(frame);
+		}
+
+		{
+			std::lock_guard<std::mutex>	lock(m_lock);
+
+			b_failed		= b_failed || !b_encoded;
+		}
+
+		m_queue_changed.notify_all();
+	}
+}
+
+void WebpAnimationEncoder::StopWorker( )
+{
+	if (!m_worker.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex>		lock(m_lock);
+
+		b_stop = true;
+	}
+
+	m_queue_changed.notify_all();
+
+	m_worker.join();
+}
+
+void WebpAnimationEncoder::SetError( _In_ const char* error )
+{
+	std::lock_guard<std::mutex>			lock(m_lock);
+
+	m_error = error ? error : "";
+}
@@ -0,0 +1,238 @@
+/********************************************************************************************************************************************************************************************
+* FileName   : WebPDecodeBufferPool.cpp
+* Description: Pool of aligned output buffers reused across decodes
+* Date		 : 17/10/2026
+* Author     : Ramesh Kumar K
+*
+********************************************************************************************************************************************************************************************/
+
+# include "WebPDecodeBufferPool.h"
+# include <stdlib.h>
+
+#ifdef _WIN32
+# include <malloc.h>
+#endif
+
+#define BUFFER_ALIGNMENT												64
+
+static uint8_t* AllocateAligned( size_t n_bytes )
+{
+#ifdef _WIN32
+	return (uint8_t*)_aligned_malloc(n_bytes, BUFFER_ALIGNMENT);
+#else
+	void *p = NULL;
+
+	return (posix_memalign(&p, BUFFER_ALIGNMENT, n_bytes) == 0) ? (uint8_t*)p : NULL;
+#endif
+}
+
+static void FreeAligned( uint8_t *p )
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+/*
+* Constructor
+*/
+WebpDecodeBufferPool::WebpDecodeBufferPool( _In_ size_t n_max_idle )
+{
+	n_max_idle_bytes					= n_max_idle;
+
+	n_clock								= 0;
+}
+
+/*
+* Destructor, buffers still handed out are freed as well so the owner must not use them after the pool is gone
+*/
+WebpDecodeBufferPool::~WebpDecodeBufferPool()
+{
+	Clear();
+
+	for (size_t i = 0; i < m_in_use.size(); ++i)
+	{
+		FreeAligned(m_in_use[i].buffer);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Returns the smallest idle buffer of at least n_bytes, as long as it isn't more than twice that, otherwise a new one
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint8_t* WebpDecodeBufferPool::Acquire( _In_ size_t n_bytes )
+{
+	if (n_bytes == 0)
+	{
+		return NULL;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		size_t n_best = m_idle.size();
+
+		for (size_t i = 0; i < m_idle.size(); ++i)
+		{
+			const size_t n_size = m_idle[i].n_bytes;
+
+			if (n_size >= n_bytes && n_size / 2 <= n_bytes && (n_best == m_idle.size() || n_size < m_idle[n_best].n_bytes))
+			{
+				n_best = i;
+			}
+		}
+
+		if (n_best < m_idle.size())
+		{
+			Entry entry = m_idle[n_best];
+
+			m_idle.erase(m_idle.begin() + n_best);
+
+			m_stats.n_idle_bytes	-= entry.n_bytes;
+			m_stats.n_bytes_in_use	+= entry.n_bytes;
+
+			++m_stats.n_hits;
+
+			m_in_use.push_back(entry);
+
+			return entry.buffer;
+		}
+	}
+
+	Entry entry;
+
+	entry.buffer		= AllocateAligned(n_bytes);
+	entry.n_bytes		= n_bytes;
+	entry.n_last_used	= 0;
+
+	if (!entry.buffer)
+	{
+		return NULL;
+	}
+
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	++m_stats.n_misses;
+
+	m_stats.n_bytes_in_use += entry.n_bytes;
+
+	if (m_stats.n_bytes_in_use + m_stats.n_idle_bytes > m_stats.n_peak_bytes)
+	{
+		m_stats.n_peak_bytes = m_stats.n_bytes_in_use + m_stats.n_idle_bytes;
+	}
+
+	m_in_use.push_back(entry);
+
+	return entry.buffer;
+}
+
+void WebpDecodeBufferPool::Release( _In_ uint8_t *buffer )
+{
+	if (!buffer)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	for (size_t i = 0; i < m_in_use.size(); ++i)
+	{
+		if (m_in_use[i].buffer == buffer)
+		{
+			Entry entry = m_in_use[i];
+
+			m_in_use.erase(m_in_use.begin() + i);
+
+			m_stats.n_bytes_in_use	-= entry.n_bytes;
+			m_stats.n_idle_bytes	+= entry.n_bytes;
+
+			entry.n_last_used		= ++n_clock;
+
+			m_idle.push_back(entry);
+
+			TrimLocked();
+
+			return;
+		}
+	}
+}
+
+size_t WebpDecodeBufferPool::GetCapacity( _In_ const uint8_t *buffer ) const
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	for (size_t i = 0; i < m_in_use.size(); ++i)
+	{
+		if (m_in_use[i].buffer == buffer)
+		{
+			return m_in_use[i].n_bytes;
+		}
+	}
+
+	return 0;
+}
+
+void WebpDecodeBufferPool::SetMaxIdleBytes( _In_ size_t n_max_idle )
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	n_max_idle_bytes = n_max_idle;
+
+	TrimLocked();
+}
+
+void WebpDecodeBufferPool::Clear( )
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	for (size_t i = 0; i < m_idle.size(); ++i)
+	{
+		FreeAligned(m_idle[i].buffer);
+	}
+
+	m_idle.clear();
+
+	m_stats.n_idle_bytes = 0;
+}
+
+WebpDecodeBufferPoolStats WebpDecodeBufferPool::GetStats( ) const
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	WebpDecodeBufferPoolStats stats	= m_stats;
+
+	stats.n_idle_buffers			= m_idle.size();
+
+	return stats;
+}
+
+/*
+* Frees the least recently used idle buffers until the idle memory fits under the cap
+*/
+void WebpDecodeBufferPool::TrimLocked( )
+{
+	while (m_stats.n_idle_bytes > n_max_idle_bytes && !m_idle.empty())
+	{
+		size_t n_oldest = 0;
+
+		for (size_t i = 1; i < m_idle.size(); ++i)
+		{
+			if (m_idle[i].n_last_used < m_idle[n_oldest].n_last_used)
+			{
+				n_oldest = i;
+			}
+		}
+
+		m_stats.n_idle_bytes -= m_idle[n_oldest].n_bytes;
+
+		++m_stats.n_evictions;
+
+		FreeAligned(m_idle[n_oldest].buffer);
+
+		m_idle.erase(m_idle.begin() + n_oldest);
+	}
+}
@@ -6,16 +6,22 @@
 *
 ********************************************************************************************************************************************************************************************/
 
-# include "WebpDecoder.h"
+# include "WebPDecoder.h"
+# include "WebPMetrics.h"
+# include <stdlib.h>
 
 #ifdef _USE_WEBP_
 # include "webp/decode.h"
 #endif
 
+#define TRACE(...)
+
 WebpDecoder::WebpDecoder()
 {
 	n_pixel_format						= PIXEL_FORMAT_RGBA;
 	ptr_decode_image					= NULL;
+	ptr_decode_into						= NULL;
+	b_use_advanced_api					= false;
 }
 
 WebpDecoder::~WebpDecoder()
@@ -33,6 +39,7 @@ void WebpDecoder::InitDecoder( )
 	case PIXEL_FORMAT_RGBA:
 		{
 			ptr_decode_image = WebPDecodeRGBA;
+			ptr_decode_into = WebPDecodeRGBAInto;
 		}
 
 		break;
@@ -40,6 +47,44 @@ void WebpDecoder::InitDecoder( )
 	case PIXEL_FORMAT_RGB:
 		{
 			ptr_decode_image = WebPDecodeRGB;
+			ptr_decode_into = WebPDecodeRGBInto;
+		}
+
+		break;
+
+	case PIXEL_FORMAT_BGR:
+		{
+			ptr_decode_image = WebPDecodeBGR;
+			ptr_decode_into = WebPDecodeBGRInto;
+		}
+
+		break;
+
+	case PIXEL_FORMAT_BGRA:
+	case PIXEL_FORMAT_BGRX:
+		{
+			ptr_decode_image = WebPDecodeBGRA;
+			ptr_decode_into = WebPDecodeBGRAInto;
+		}
+
+		break;
+
+	case PIXEL_FORMAT_ARGB:
+		{
+			ptr_decode_image = WebPDecodeARGB;
+			ptr_decode_into = WebPDecodeARGBInto;
+		}
+
+		break;
+
+	case PIXEL_FORMAT_RGBA_PREMULTIPLIED:
+	case PIXEL_FORMAT_RGB565:
+	case PIXEL_FORMAT_RGBA4444:
+	case PIXEL_FORMAT_YUV420:
+	case PIXEL_FORMAT_YUVA420:
+		{
+			ptr_decode_image = NULL;		// no simple API function, these go through WebPDecode with the colorspace set
+			ptr_decode_into = NULL;
 		}
 
 		break;
@@ -48,6 +93,7 @@ void WebpDecoder::InitDecoder( )
 
 		{
 			ptr_decode_image = WebPDecodeRGBA;
+			ptr_decode_into = WebPDecodeRGBAInto;
 		}
 	}
 
@@ -62,18 +108,773 @@ bool WebpDecoder::SetOutPutPixelFormat( IMG_PIXEL_FORMATS pixel_format )
 	return true;
 }
 
+bool WebpDecoder::SetDecodeOptions( _In_ const WebpDecodeOptions &options )
+{
+	if (options.b_use_cropping && (options.n_crop_left < 0 || options.n_crop_top < 0 || options.n_crop_width <= 0 || options.n_crop_height <= 0))
+	{
+		return false;
+	}
+
+	if (options.b_use_scaling && (options.n_scaled_width < 0 || options.n_scaled_height < 0 || (options.n_scaled_width == 0 && options.n_scaled_height == 0)))
+	{
+		return false;
+	}
+
+	if (options.n_dithering_strength < 0 || options.n_dithering_strength > 100 || options.n_alpha_dithering_strength < 0 || options.n_alpha_dithering_strength > 100)
+	{
+		return false;
+	}
+
+	m_options			= options;
+
+	b_use_advanced_api	= options.b_use_cropping || options.b_use_scaling || options.b_use_threads || options.b_bypass_filtering || options.b_no_fancy_upsampling ||
+						  options.n_dithering_strength > 0 || options.n_alpha_dithering_strength > 0 || options.b_flip;
+
+	return true;
+}
+
+const WebpDecodeOptions& WebpDecoder::GetDecodeOptions( ) const
+{
+	return m_options;
+}
+
+/*
+* Caps the SIMD level of libwebp's decoding functions and of our kernels, best called before the first decode
+*/
+void WebpDecoder::SetInstructionSetCeiling( _In_ WEBP_KERNEL_ISA n_ceiling )
+{
+	WebpSetIsaCeiling(n_ceiling);
+}
+
+WEBP_KERNEL_ISA WebpDecoder::GetInstructionSet( )
+{
+	return WebpGetActiveIsa();
+}
+
+int WebpDecoder::GetBytesPerPixel( ) const
+{
+	switch (n_pixel_format)
+	{
+	case PIXEL_FORMAT_RGB:
+	case PIXEL_FORMAT_BGR:			return 3;
+	case PIXEL_FORMAT_RGB565:
+	case PIXEL_FORMAT_RGBA4444:		return 2;
+	case PIXEL_FORMAT_YUV420:
+	case PIXEL_FORMAT_YUVA420:		return 1;
+	default:						return 4;
+	}
+}
+
+static bool IsPlanarYUV( IMG_PIXEL_FORMATS pixel_format )
+{
+	return pixel_format == PIXEL_FORMAT_YUV420 || pixel_format == PIXEL_FORMAT_YUVA420;
+}
+
+/*
+* Packed formats need out_stride * (height - 1) plus one row, planar ones the whole I420 layout the encoder reads as well: Y rows of
+* out_stride bytes, U and V rows of (out_stride + 1) / 2 bytes, then the alpha rows of out_stride bytes for YUVA420
+*/
+size_t WebpDecoder::GetOutputBufferSize( _In_ int width, _In_ int height, _In_ int out_stride ) const
+{
+	if (width <= 0 || height <= 0)
+	{
+		return 0;
+	}
+
+	if (out_stride == 0)
+	{
+		out_stride = width * GetBytesPerPixel();
+	}
+
+	if (IsPlanarYUV(n_pixel_format))
+	{
+		const size_t y_size		= (size_t)out_stride * height;
+		const size_t uv_size	= (size_t)((out_stride + 1) >> 1) * ((height + 1) >> 1);
+
+		return y_size + 2 * uv_size + ((n_pixel_format == PIXEL_FORMAT_YUVA420) ? y_size : 0);
+	}
+
+	return (size_t)out_stride * (height - 1) + (size_t)width * GetBytesPerPixel();
+}
+
+/*
+* Records one decode in WebPMetrics, on failure the bitstream is parsed again to tell a truncated file from a corrupt one
+*/
+static void RecordDecode( uint64_t n_metrics_start, const uint8_t* in_image, size_t data_size, bool b_ok, int width, int height, size_t n_bytes_out )
+{
+#ifdef _USE_WEBP_
+	if (n_metrics_start)
+	{
+		int n_status = VP8_STATUS_OK;
+
+		if (!b_ok)
+		{
+			WebPBitstreamFeatures features;
+
+			n_status = WebPGetFeatures(in_image, data_size, &features);
+
+			if (n_status == VP8_STATUS_OK)
+			{
+				n_status = VP8_STATUS_BITSTREAM_ERROR;
+			}
+		}
+
+		const uint64_t n_pixels = (n_status == VP8_STATUS_OK) ? (uint64_t)width * height : 0;
+
+		WEBP_METRICS_RECORD(WEBP_METRIC_OP_DECODE, n_metrics_start, n_pixels, data_size, n_pixels ? n_bytes_out : 0, n_status);
+	}
+#else
+	(void)n_metrics_start; (void)in_image; (void)data_size; (void)b_ok; (void)width; (void)height; (void)n_bytes_out;
+#endif
+}
+
 bool WebpDecoder::DecodeImage( _In_ const uint8_t* in_image, _In_ size_t data_size, _In_ int &width, _In_ int &height, _Inout_ uint8_t** out_image )
 {
 	bool result = true;
 
+	WEBP_METRICS_START(n_metrics_start);
+
+	try
+	{
+		if (b_use_advanced_api || !ptr_decode_image)
+		{
+			result = DecodeAdvanced(in_image, data_size, NULL, 0, 0, width, height, out_image);
+		}
+		else
+		{
+			*out_image = ptr_decode_image(in_image, data_size, &width, &height);
+		}
+	}
+	catch(...) 
+	{
+		result = false;
+	}
+
+	RecordDecode(n_metrics_start, in_image, data_size, result && *out_image != NULL, width, height, GetOutputBufferSize(width, height, 0));
+
+	return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Decoding into caller owned memory with libwebp's *Into functions, which wrap the buffer in an external memory WebPDecBuffer
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WebpDecoder::DecodeInto( _In_ const uint8_t* in_image, _In_ size_t data_size, _Inout_ uint8_t* out_buffer, _In_ size_t out_buffer_size, _In_ int out_stride, _Inout_ int &width, _Inout_ int &height )
+{
+	bool result = false;
+
+#ifdef _USE_WEBP_
+
+	WEBP_METRICS_START(n_metrics_start);
+
+	width	= 0;
+	height	= 0;
+
+	if (!GetOutputSize(in_image, data_size, width, height))
+	{
+		goto Error;
+	}
+
+	if (!out_buffer || out_stride < width * GetBytesPerPixel() || out_buffer_size < GetOutputBufferSize(width, height, out_stride))
+	{
+		TRACE(_T("DecodeInto: a %dx%d image doesn't fit the %u byte buffer with stride %d\n"), width, height, (unsigned)out_buffer_size, out_stride);
+
+		goto Error;
+	}
+
 	try
 	{
-		*out_image = ptr_decode_image(in_image, data_size, &width, &height);
+		if (b_use_advanced_api || !ptr_decode_into)
+		{
+			result = DecodeAdvanced(in_image, data_size, out_buffer, out_buffer_size, out_stride, width, height, NULL);
+		}
+		else
+		{
+			result = ptr_decode_into(in_image, data_size, out_buffer, out_buffer_size, out_stride) != NULL;
+		}
 	}
 	catch(...) 
 	{
 		result = false;
 	}
 
+Error:
+
+	RecordDecode(n_metrics_start, in_image, data_size, result, width, height, GetOutputBufferSize(width, height, 0));
+
+#endif
+
 	return result;
-}
\ No newline at end of file
+}
+
+bool WebpDecoder::DecodePooled( _In_ const uint8_t* in_image, _In_ size_t data_size, _Inout_ WebpDecodeBufferPool &pool, _In_ int out_stride, _Inout_ int &width, _Inout_ int &height, _Inout_ uint8_t** out_image )
+{
+	*out_image = NULL;
+
+#ifdef _USE_WEBP_
+
+	if (!GetOutputSize(in_image, data_size, width, height))
+	{
+		return false;
+	}
+
+	if (out_stride == 0)
+	{
+		out_stride = width * GetBytesPerPixel();
+	}
+
+	uint8_t *buffer = pool.Acquire(GetOutputBufferSize(width, height, out_stride));
+
+	if (!buffer)
+	{
+		return false;
+	}
+
+	if (!DecodeInto(in_image, data_size, buffer, pool.GetCapacity(buffer), out_stride, width, height))
+	{
+		pool.Release(buffer);
+
+		return false;
+	}
+
+	*out_image = buffer;
+
+	return true;
+
+#else
+
+	(void)data_size; (void)pool; (void)out_stride; (void)width; (void)height;
+
+	return false;
+
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// The advanced API, WebPDecode with a WebPDecoderConfig built from WebpDecodeOptions. libwebp crops before it reconstructs the rows and
+// scales them as they come out of the decoder, so a thumbnail never goes through a full size RGBA buffer.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifdef _USE_WEBP_
+
+static WEBP_CSP_MODE GetColorspace( IMG_PIXEL_FORMATS n_pixel_format )
+{
+	switch (n_pixel_format)
+	{
+	case PIXEL_FORMAT_RGB:					return MODE_RGB;
+	case PIXEL_FORMAT_BGR:					return MODE_BGR;
+	case PIXEL_FORMAT_BGRA:
+	case PIXEL_FORMAT_BGRX:					return MODE_BGRA;
+	case PIXEL_FORMAT_ARGB:					return MODE_ARGB;
+	case PIXEL_FORMAT_RGBA_PREMULTIPLIED:	return MODE_rgbA;
+	case PIXEL_FORMAT_RGB565:				return MODE_RGB_565;
+	case PIXEL_FORMAT_RGBA4444:				return MODE_RGBA_4444;
+	case PIXEL_FORMAT_YUV420:				return MODE_YUV;
+	case PIXEL_FORMAT_YUVA420:				return MODE_YUVA;
+	default:								return MODE_RGBA;
+	}
+}
+
+/*
+* Points an external memory WebPDecBuffer at the caller's buffer, the planes of the YUV modes laid out as in GetOutputBufferSize
+*/
+static void SetExternalBuffer( WebPDecBuffer &output, uint8_t* out_buffer, size_t out_buffer_size, int out_stride, int height )
+{
+	output.is_external_memory		= 1;
+
+	if (WebPIsRGBMode(output.colorspace))
+	{
+		output.u.RGBA.rgba			= out_buffer;
+		output.u.RGBA.stride		= out_stride;
+		output.u.RGBA.size			= out_buffer_size;
+
+		return;
+	}
+
+	const int		uv_stride		= (out_stride + 1) >> 1;
+	const size_t	y_size			= (size_t)out_stride * height;
+	const size_t	uv_size			= (size_t)uv_stride * ((height + 1) >> 1);
+
+	output.u.YUVA.y					= out_buffer;
+	output.u.YUVA.u					= out_buffer + y_size;
+	output.u.YUVA.v					= out_buffer + y_size + uv_size;
+	output.u.YUVA.y_stride			= out_stride;
+	output.u.YUVA.u_stride			= uv_stride;
+	output.u.YUVA.v_stride			= uv_stride;
+	output.u.YUVA.y_size			= y_size;
+	output.u.YUVA.u_size			= uv_size;
+	output.u.YUVA.v_size			= uv_size;
+
+	if (output.colorspace == MODE_YUVA)
+	{
+		output.u.YUVA.a				= out_buffer + y_size + 2 * uv_size;
+		output.u.YUVA.a_stride		= out_stride;
+		output.u.YUVA.a_size		= y_size;
+	}
+}
+
+/*
+* width and height are the output size from GetOutputSize, with the aspect ratio of a 0 scaled dimension already resolved
+*/
+static void SetDecoderOptions( const WebpDecodeOptions &options, int width, int height, WebPDecoderOptions &out )
+{
+	out.use_cropping				= options.b_use_cropping;
+	out.crop_left					= options.n_crop_left;
+	out.crop_top					= options.n_crop_top;
+	out.crop_width					= options.n_crop_width;
+	out.crop_height					= options.n_crop_height;
+	out.use_scaling					= options.b_use_scaling;
+	out.scaled_width				= width;
+	out.scaled_height				= height;
+	out.use_threads					= options.b_use_threads;
+	out.bypass_filtering			= options.b_bypass_filtering;
+	out.no_fancy_upsampling			= options.b_no_fancy_upsampling;
+	out.dithering_strength			= options.n_dithering_strength;
+	out.alpha_dithering_strength	= options.n_alpha_dithering_strength;
+	out.flip						= options.b_flip;
+}
+
+#endif
+
+bool WebpDecoder::GetOutputSize( _In_ const uint8_t* in_image, _In_ size_t data_size, _Inout_ int &width, _Inout_ int &height ) const
+{
+#ifdef _USE_WEBP_
+
+	if (!in_image || !WebPGetInfo(in_image, data_size, &width, &height))
+	{
+		return false;
+	}
+
+	if (m_options.b_use_cropping)
+	{
+		if (m_options.n_crop_left + m_options.n_crop_width > width || m_options.n_crop_top + m_options.n_crop_height > height)
+		{
+			TRACE(_T("Crop rectangle outside the %dx%d image\n"), width, height);
+
+			return false;
+		}
+
+		width	= m_options.n_crop_width;
+		height	= m_options.n_crop_height;
+	}
+
+	if (m_options.b_use_scaling)
+	{
+		int n_scaled_width	= m_options.n_scaled_width;
+		int n_scaled_height	= m_options.n_scaled_height;
+
+		if (n_scaled_width == 0)
+		{
+			n_scaled_width	= (int)(((int64_t)width * n_scaled_height + height / 2) / height);
+		}
+		else if (n_scaled_height == 0)
+		{
+			n_scaled_height	= (int)(((int64_t)height * n_scaled_width + width / 2) / width);
+		}
+
+		width	= (n_scaled_width > 0) ? n_scaled_width : 1;
+		height	= (n_scaled_height > 0) ? n_scaled_height : 1;
+	}
+
+	return true;
+
+#else
+
+	(void)in_image; (void)data_size; (void)width; (void)height;
+
+	return false;
+
+#endif
+}
+
+/*
+* Decodes into out_buffer when it is given, otherwise into a buffer libwebp allocates and *out_image takes over (released with FreeImage)
+*/
+bool WebpDecoder::DecodeAdvanced( _In_ const uint8_t* in_image, _In_ size_t data_size, _Inout_ uint8_t* out_buffer, _In_ size_t out_buffer_size, _In_ int out_stride, _Inout_ int &width, _Inout_ int &height, _Inout_ uint8_t** out_image )
+{
+#ifdef _USE_WEBP_
+
+	WebPDecoderConfig config;
+
+	if (out_image)
+	{
+		*out_image = NULL;
+	}
+
+	if (!WebPInitDecoderConfig(&config) || !GetOutputSize(in_image, data_size, width, height))
+	{
+		return false;
+	}
+
+	SetDecoderOptions(m_options, width, height, config.options);
+
+	config.output.colorspace		= GetColorspace(n_pixel_format);
+
+	if (out_buffer)
+	{
+		SetExternalBuffer(config.output, out_buffer, out_buffer_size, out_stride, height);
+	}
+
+	const VP8StatusCode n_status = WebPDecode(in_image, data_size, &config);
+
+	if (n_status != VP8_STATUS_OK)
+	{
+		TRACE(_T("WebPDecode failed with status %d\n"), (int)n_status);
+
+		WebPFreeDecBuffer(&config.output);
+
+		return false;
+	}
+
+	width	= config.output.width;
+	height	= config.output.height;
+
+	if (!out_buffer && out_image)
+	{
+		// the start of libwebp's allocation, WebPFree releases it. Its YUV planes follow each other with the strides of GetOutputBufferSize.
+
+		*out_image = WebPIsRGBMode(config.output.colorspace) ? config.output.u.RGBA.rgba : config.output.u.YUVA.y;
+	}
+
+	return true;
+
+#else
+
+	(void)in_image; (void)data_size; (void)out_buffer; (void)out_buffer_size; (void)out_stride; (void)width; (void)height; (void)out_image;
+
+	return false;
+
+#endif
+}
+
+/*
+* WebPGetFeatures only parses headers, so this costs the same on a 64 byte prefix as on the whole file
+*/
+bool WebpDecoder::Probe( _In_ const uint8_t* in_image, _In_ size_t data_size, _Inout_ WebpImageInfo &info )
+{
+	info = WebpImageInfo();
+
+#ifdef _USE_WEBP_
+
+	WebPBitstreamFeatures features;
+
+	if (!in_image)
+	{
+		info.n_status = VP8_STATUS_INVALID_PARAM;
+
+		return false;
+	}
+
+	info.n_status = WebPGetFeatures(in_image, data_size, &features);
+
+	if (info.n_status != VP8_STATUS_OK)
+	{
+		return false;
+	}
+
+	info.width			= features.width;
+	info.height			= features.height;
+	info.b_has_alpha	= features.has_alpha != 0;
+	info.b_is_animated	= features.has_animation != 0;
+	info.n_coding		= (features.format == 1) ? WEBP_IMAGE_CODING_LOSSY : (features.format == 2) ? WEBP_IMAGE_CODING_LOSSLESS : WEBP_IMAGE_CODING_UNKNOWN;
+
+	return true;
+
+#else
+
+	(void)data_size;
+
+	return false;
+
+#endif
+}
+
+void WebpDecoder::FreeImage( _In_ uint8_t* image )
+{
+#ifdef _USE_WEBP_
+	WebPFree(image);
+#else
+	free(image);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// WebpDecodeSession. The incremental decoder is created once the first bytes hold the headers, so the output size of cropping and scaling can
+// be resolved the same way as in DecodeAdvanced; until then the bytes are kept in m_header, a few dozen for a still image.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+WebpDecodeSession::WebpDecodeSession()
+{
+	m_config							= NULL;
+	m_idec								= NULL;
+	m_out_buffer						= NULL;
+	n_out_buffer_size					= 0;
+	n_out_stride						= 0;
+	n_rows_done							= 0;
+	n_status							= 0;
+	n_state								= WEBP_DECODE_SESSION_ERROR;
+	n_bytes_in							= 0;
+	n_metrics_start						= 0;
+}
+
+WebpDecodeSession::~WebpDecodeSession()
+{
+	End();
+}
+
+bool WebpDecodeSession::Begin( _In_ const WebpDecoder &decoder, _Inout_opt_ uint8_t* out_buffer, _In_ size_t out_buffer_size, _In_ int out_stride )
+{
+	End();
+
+#ifdef _USE_WEBP_
+
+	m_config = new WebPDecoderConfig;
+
+	if (!WebPInitDecoderConfig(m_config))
+	{
+		End();
+
+		return false;
+	}
+
+	m_decoder			= decoder;
+	m_out_buffer		= out_buffer;
+	n_out_buffer_size	= out_buffer_size;
+	n_out_stride		= out_stride;
+	n_status			= VP8_STATUS_OK;
+	n_state				= WEBP_DECODE_SESSION_NEED_MORE_DATA;
+
+	return true;
+
+#else
+
+	(void)decoder; (void)out_buffer; (void)out_buffer_size; (void)out_stride;
+
+	return false;
+
+#endif
+}
+
+/*
+* Sets up m_config from the decoder's options once the headers in m_header are complete. False while they aren't, n_status tells why.
+*/
+bool WebpDecodeSession::StartDecoder( )
+{
+#ifdef _USE_WEBP_
+
+	int width	= 0;
+	int height	= 0;
+
+	if (!m_decoder.GetOutputSize(&m_header[0], m_header.size(), width, height))
+	{
+		WebPBitstreamFeatures features;
+
+		n_status = WebPGetFeatures(&m_header[0], m_header.size(), &features);
+
+		if (n_status == VP8_STATUS_OK)
+		{
+			n_status = VP8_STATUS_INVALID_PARAM;		// the headers are fine, the crop rectangle isn't
+		}
+
+		return false;
+	}
+
+	SetDecoderOptions(m_decoder.m_options, width, height, m_config->options);
+
+	m_config->output.colorspace			= GetColorspace(m_decoder.n_pixel_format);
+
+	if (m_out_buffer)
+	{
+		SetExternalBuffer(m_config->output, m_out_buffer, n_out_buffer_size, n_out_stride, height);
+	}
+
+	m_idec = WebPIDecode(NULL, 0, m_config);
+
+	if (!m_idec)
+	{
+		n_status = VP8_STATUS_OUT_OF_MEMORY;
+
+		return false;
+	}
+
+	return true;
+
+#else
+
+	return false;
+
+#endif
+}
+
+WEBP_DECODE_SESSION_STATUS WebpDecodeSession::Push( _In_ const uint8_t* data, _In_ size_t data_size, _Inout_ int &first_row, _Inout_ int &n_rows )
+{
+	first_row	= n_rows_done;
+	n_rows		= 0;
+
+#ifdef _USE_WEBP_
+
+	if (n_state != WEBP_DECODE_SESSION_NEED_MORE_DATA || !m_config)
+	{
+		return n_state;
+	}
+
+	if (n_bytes_in == 0)
+	{
+		WEBP_METRICS_START(n_start);		// the first Push starts the clock, the last one records
+
+		n_metrics_start = n_start;
+	}
+
+	if (data_size == 0)
+	{
+		return n_state;
+	}
+
+	if (!data)
+	{
+		n_status	= VP8_STATUS_INVALID_PARAM;
+		n_state		= WEBP_DECODE_SESSION_ERROR;
+
+		return n_state;
+	}
+
+	n_bytes_in += data_size;
+
+	if (!m_idec)
+	{
+		m_header.insert(m_header.end(), data, data + data_size);
+
+		if (!StartDecoder())
+		{
+			if (n_status != VP8_STATUS_NOT_ENOUGH_DATA)
+			{
+				n_state = WEBP_DECODE_SESSION_ERROR;
+
+				RecordDecode(n_metrics_start, &m_header[0], m_header.size(), false, 0, 0, 0);
+			}
+
+			return n_state;
+		}
+
+		data		= &m_header[0];
+		data_size	= m_header.size();
+	}
+
+	n_status = WebPIAppend(m_idec, data, data_size);
+
+	std::vector<uint8_t>().swap(m_header);
+
+	int n_last_row	= n_rows_done;
+	int width		= 0;
+	int height		= 0;
+
+	if (n_status == VP8_STATUS_OK || n_status == VP8_STATUS_SUSPENDED)
+	{
+		if (WebPIsRGBMode(m_config->output.colorspace))
+		{
+			WebPIDecGetRGB(m_idec, &n_last_row, &width, &height, NULL);
+		}
+		else
+		{
+			WebPIDecGetYUVA(m_idec, &n_last_row, NULL, NULL, NULL, &width, &height, NULL, NULL, NULL);
+		}
+
+		n_rows		= n_last_row - n_rows_done;
+		n_rows_done	= n_last_row;
+	}
+
+	if (n_status == VP8_STATUS_OK)
+	{
+		n_state = WEBP_DECODE_SESSION_DONE;
+	}
+	else if (n_status != VP8_STATUS_SUSPENDED)
+	{
+		TRACE(_T("WebPIAppend failed with status %d after %u bytes\n"), n_status, (unsigned)n_bytes_in);
+
+		n_state = WEBP_DECODE_SESSION_ERROR;
+	}
+
+	if (n_metrics_start && n_state != WEBP_DECODE_SESSION_NEED_MORE_DATA)
+	{
+		const bool		b_ok		= (n_state == WEBP_DECODE_SESSION_DONE);
+		const uint64_t	n_pixels	= b_ok ? (uint64_t)width * height : 0;
+
+		WEBP_METRICS_RECORD(WEBP_METRIC_OP_DECODE, n_metrics_start, n_pixels, n_bytes_in, n_pixels ? m_decoder.GetOutputBufferSize(width, height, 0) : 0, n_status);
+	}
+
+	return n_state;
+
+#else
+
+	(void)data; (void)data_size;
+
+	return WEBP_DECODE_SESSION_ERROR;
+
+#endif
+}
+
+const uint8_t* WebpDecodeSession::GetRows( _Inout_ int &n_rows, _Inout_ int &width, _Inout_ int &height, _Inout_ int &stride ) const
+{
+	n_rows = width = height = stride = 0;
+
+#ifdef _USE_WEBP_
+
+	if (!m_idec)
+	{
+		return NULL;
+	}
+
+	if (!WebPIsRGBMode(m_config->output.colorspace))
+	{
+		int n_uv_stride = 0;
+		int n_a_stride	= 0;
+
+		return WebPIDecGetYUVA(m_idec, &n_rows, NULL, NULL, NULL, &width, &height, &stride, &n_uv_stride, &n_a_stride);
+	}
+
+	return WebPIDecGetRGB(m_idec, &n_rows, &width, &height, &stride);
+
+#else
+
+	return NULL;
+
+#endif
+}
+
+int WebpDecodeSession::GetLastStatus( ) const
+{
+	return n_status;
+}
+
+/*
+* Frees the decoder and its output unless it was the caller's buffer
+*/
+void WebpDecodeSession::End( )
+{
+#ifdef _USE_WEBP_
+
+	if (m_idec)
+	{
+		WebPIDelete(m_idec);
+	}
+
+	delete m_config;
+
+#endif
+
+	m_idec				= NULL;
+	m_config			= NULL;
+	m_out_buffer		= NULL;
+	n_rows_done			= 0;
+	n_bytes_in			= 0;
+	n_metrics_start		= 0;
+	n_state				= WEBP_DECODE_SESSION_ERROR;
+
+	std::vector<uint8_t>().swap(m_header);
+}
@@ -6,9 +6,18 @@
 *
 ********************************************************************************************************************************************************************************************/
 
-# include "WebPEncoder.h"
+# include "WebPencoder.h"
+# include "WebPThreadPool.h"
+# include "WebPOutputSink.h"
+# include "WebPMetrics.h"
+# include <chrono>
+# include <limits.h>
+# include <math.h>
+# include <string.h>
+# include <utility>
 #ifdef _USE_WEBP_
 # include "webp/encode.h"
+# include "webp/decode.h"
 #endif
 
 #ifdef HAVE_CONFIG_H
@@ -26,32 +35,40 @@
 //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-#ifndef WEBP_DLL
-#ifdef __cplusplus
-extern "C" {
-#endif
+#define TRACE(...)
 
-extern void* VP8GetCPUInfo;   // opaque forward declaration.
+/*
+* Monotonic clock in milliseconds for the stage timings
+*/
+static double GetTimeMs( )
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-#ifdef __cplusplus
-}    // extern "C"
-#endif
-#endif  // WEBP_DLL
+/*
+* State owned by one pool worker, the output writer and the plane copies keep their buffers from one batch item to the next. Pictures aren't
+* kept: libwebp's import reallocates the planes anyway, only the picture pool (b_use_picture_pool) reuses them.
+*/
+struct WebpEncoderWorker
+{
+#ifdef _USE_WEBP_
 
+	WebPMemoryWriter													memory_writer;
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//
-// Static and globals variables
-//
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	std::vector<uint8_t>												plane_scratch;	// what m_plane_scratch is to the single image encodes
 
-#ifdef _USE_WEBP_
+	WebpEncoderWorker()
+	{
+		WebPMemoryWriterInit(&memory_writer);
+	}
 
-static WebPConfig												m_webp_config;
+	~WebpEncoderWorker()
+	{
+		WebPMemoryWriterClear(&memory_writer);
+	}
 
 #endif
-
-#define TRACE(...)
+};
 
 /*------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 *
@@ -116,23 +133,23 @@ static int ReadYUV(const uint8_t* const data, size_t data_size,
 static int ReadPicture(const char* const filename, WebPPicture* const pic,
                        int keep_alpha, Metadata* const metadata) {
   int ok = 0;
-  const uint8_t* data = NULL;
-  size_t data_size = 0;
+  ImgIoUtilFileView view;
+  memset(&view, 0, sizeof(view));
   if (pic->width != 0 && pic->height != 0) {
-    ok = ImgIoUtilReadFile(filename, &data, &data_size);
-    ok = ok && ReadYUV(data, data_size, pic);
+    ok = ImgIoUtilOpenFileView(filename, &view);
+    ok = ok && ReadYUV(view.data, view.size, pic);
   } else {
     // If no size specified, try to decode it using WIC.
     ok = ReadPictureWithWIC(filename, pic, keep_alpha, metadata);
     if (!ok) {
-      ok = ImgIoUtilReadFile(filename, &data, &data_size);
-      ok = ok && ReadWebP(data, data_size, pic, keep_alpha, metadata);
+      ok = ImgIoUtilOpenFileView(filename, &view);
+      ok = ok && ReadWebP(view.data, view.size, pic, keep_alpha, metadata);
     }
   }
   if (!ok) {
     LOG(CRITICAL) << _T("Error! Could not process file ") << filename;
   }
-  free((void*)data);
+  ImgIoUtilCloseFileView(&view);
   return ok;
 }
 
@@ -140,25 +157,24 @@ static int ReadPicture(const char* const filename, WebPPicture* const pic,
 
 static int ReadPicture(const TCHAR* const filename, WebPPicture* const pic,
                        int keep_alpha, Metadata* const metadata) {
-  const uint8_t* data = NULL;
-  size_t data_size = 0;
+  ImgIoUtilFileView view;   // the readers only need the bytes, so the file is mapped rather than copied
   int ok = 0;
 
-  ok = ImgIoUtilReadFile(filename, &data, &data_size);
+  ok = ImgIoUtilOpenFileView(filename, &view);
   if (!ok) goto End;
 
   if (pic->width == 0 || pic->height == 0) {
-    WebPImageReader reader = WebPGuessImageReader(data, data_size);
-    ok = reader(data, data_size, pic, keep_alpha, metadata);
+    WebPImageReader reader = WebPGuessImageReader(view.data, view.size);
+    ok = reader(view.data, view.size, pic, keep_alpha, metadata);
   } else {
     // If image size is specified, infer it as YUV format.
-    ok = ReadYUV(data, data_size, pic);
+    ok = ReadYUV(view.data, view.size, pic);
   }
  End:
   if (!ok) {
     LOG(CRITICAL) << _T("Error! Could not process file ") << filename;
   }
-  free((void*)data);
+  ImgIoUtilCloseFileView(&view);
   return ok;
 }
 
@@ -218,18 +234,153 @@ WebpEncoder::WebpEncoder()
 
 	background_color					= 0xffffffu;
 
+	ptr_encode_image					= NULL;
+
+	b_config_valid						= false;
+
+	b_keep_alpha						= false;
+
+	b_rate_control						= false;
+
+	b_collect_stats						= false;
+
+	b_scale = b_crop = b_blend_alpha	= false;
+
+	resize_w = resize_h					= false;
+
+	crop_x = crop_y = crop_w = crop_h	= 0;
+
+	n_worker_threads					= 1;
+
+	m_thread_pool						= NULL;
+
+	n_picture_pool_bytes				= 0;
+
+	m_picture_pool						= NULL;
+
 #ifdef _USE_WEBP_
 	WebPConfigInit(&m_webp_config);
+	WebPMemoryWriterInit(&m_output_arena);
 #endif
 
 }
 
+/*
+* Copy constructor, the new encoder gets its own copy of the already validated config. Every member is initialised by the default constructor
+* first since operator= compares against the current thread and pool settings.
+*/
+WebpEncoder::WebpEncoder( const WebpEncoder &other ) : WebpEncoder()
+{
+	*this = other;
+}
+
 /*
 * Destructor
 */
 WebpEncoder::~WebpEncoder()
 {
+	ReleaseWorkers();
+
+#ifdef _USE_WEBP_
+	delete m_picture_pool;
+
+	WebPMemoryWriterClear(&m_output_arena);
+#endif
+}
+
+/*
+* Returns the pool of this encoder, creating it and the per worker state on first use
+*/
+WebpThreadPool* WebpEncoder::GetThreadPool( )
+{
+	if (!m_thread_pool)
+	{
+		m_thread_pool = new WebpThreadPool(n_worker_threads);
+
+		for (unsigned int i = 0; i < m_thread_pool->GetThreadCount(); ++i)
+		{
+			m_workers.push_back(new WebpEncoderWorker());
+		}
+	}
+
+	return m_thread_pool;
+}
+
+/*
+* Stops the pool and frees the per worker output buffers, they are created again on the next batch
+*/
+void WebpEncoder::ReleaseWorkers( )
+{
+	delete m_thread_pool;
+
+	m_thread_pool = NULL;
+
+	for (size_t i = 0; i < m_workers.size(); ++i)
+	{
+		delete m_workers[i];
+	}
+
+	m_workers.clear();
+}
+
+/*
+* Clones the settings of another encoder, no re-validation is needed as the source config was validated by its InitEncoder
+*/
+WebpEncoder& WebpEncoder::operator=( const WebpEncoder &other )
+{
+	if (this != &other)
+	{
+		ptr_encode_image				= other.ptr_encode_image;
+
+		n_pixel_format					= other.n_pixel_format;
+
+		b_config_valid					= other.b_config_valid;
+
+		b_keep_alpha					= other.b_keep_alpha;
+
+		b_rate_control					= other.b_rate_control;
+
+		m_last_rate_control				= WebpRateControlResult();
+
+		b_collect_stats					= other.b_collect_stats;
+
+		m_last_stats					= WebpEncodeStats();
+
+		if (n_worker_threads != other.n_worker_threads)
+		{
+			ReleaseWorkers();		// the pool itself is never shared, only its size
+		}
+
+		n_worker_threads				= other.n_worker_threads;
+
+#ifdef _USE_WEBP_
+		if (n_picture_pool_bytes != other.n_picture_pool_bytes)
+		{
+			delete m_picture_pool;		// sized for the old limit
+
+			m_picture_pool				= NULL;
+		}
+#endif
+
+		n_picture_pool_bytes			= other.n_picture_pool_bytes;		// the clone gets a pool of its own on first use
+
+		b_scale							= other.b_scale;
+		b_crop							= other.b_crop;
+		b_blend_alpha					= other.b_blend_alpha;
+		resize_w						= other.resize_w;
+		resize_h						= other.resize_h;
+		crop_x							= other.crop_x;
+		crop_y							= other.crop_y;
+		crop_w							= other.crop_w;
+		crop_h							= other.crop_h;
+		background_color				= other.background_color;
+
+#ifdef _USE_WEBP_
+		m_webp_config					= other.m_webp_config;
+#endif
+	}
 
+	return *this;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -239,10 +390,15 @@ WebpEncoder::~WebpEncoder()
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /*
-* Sets the pixel format to be used to handle the images
+* Sets the pixel format to be used to handle the images, false for the decoder only formats (RGB565, RGBA4444)
 */
 bool WebpEncoder::SetPixelFormat( IMG_PIXEL_FORMATS pixel_format )
 {
+	if (!GetInputBytesPerPixel(pixel_format))
+	{
+		return false;
+	}
+
 	n_pixel_format = pixel_format;
 
 	return true;
@@ -260,6 +416,13 @@ bool WebpEncoder::InitEncoder( ImageCompressionProperties	&config )
 
 #ifdef _USE_WEBP_
 
+	if (!GetInputBytesPerPixel(n_pixel_format))
+	{
+		TRACE(_T("Error! RGB565 and RGBA4444 are decoder output formats only"));
+		b_config_valid = false;
+		return false;
+	}
+
 	switch (n_pixel_format)
 	{
 	case PIXEL_FORMAT_RGBA:
@@ -276,6 +439,20 @@ bool WebpEncoder::InitEncoder( ImageCompressionProperties	&config )
 
 		break;
 
+	case PIXEL_FORMAT_BGR:
+		{
+			ptr_encode_image = WebPEncodeBGR;
+		}
+
+		break;
+
+	case PIXEL_FORMAT_BGRA:
+		{
+			ptr_encode_image = WebPEncodeBGRA;
+		}
+
+		break;
+
 	default:
 
 		{
@@ -283,6 +460,59 @@ bool WebpEncoder::InitEncoder( ImageCompressionProperties	&config )
 		}
 	}
 
+	b_config_valid					= false;
+
+	b_keep_alpha					= config.b_retain_alpha;
+
+	TRACE(_T("SIMD path: %hs (cpu %hs)"), WebpGetIsaName(WebpGetActiveIsa()), WebpGetIsaName(WebpGetCpuKernelIsa()));
+
+	if (!config.b_use_sse2_instruction_set && WebpGetActiveIsa() != WEBP_KERNEL_ISA_SCALAR)
+	{
+		// The SIMD level is process wide and can't be dropped for one encoder, the caller must lower the ceiling first
+
+		TRACE(_T("Error! SSE2 turned off in the config but the SIMD ceiling allows %hs, call SetInstructionSetCeiling(WEBP_KERNEL_ISA_SCALAR)"), WebpGetIsaName(WebpGetActiveIsa()));
+		return false;
+	}
+
+	unsigned int n_threads			= 1;
+
+	if (config.b_use_parallel_processing)
+	{
+		n_threads = config.n_thread_count ? config.n_thread_count : WebpThreadPool::GetHardwareThreadCount();
+	}
+
+	if (n_threads != n_worker_threads)
+	{
+		ReleaseWorkers();
+	}
+
+	n_worker_threads				= n_threads;
+
+	n_picture_pool_bytes			= config.b_use_picture_pool ? config.n_picture_pool_max_bytes : 0;
+
+	if (m_picture_pool)
+	{
+		if (n_picture_pool_bytes)
+		{
+			m_picture_pool->SetMaxIdleBytes(n_picture_pool_bytes);
+		}
+		else
+		{
+			delete m_picture_pool;
+
+			m_picture_pool = NULL;
+		}
+	}
+
+	// the preset resets every field of the config, so it has to be applied before our own settings
+
+	WebPPreset preset = WEBP_PRESET_TEXT;
+	
+	if (!WebPConfigPreset(&m_webp_config, preset, config.f_quality_factor)) 
+	{
+		return false;
+	}
+
 	m_webp_config.quality			= config.f_quality_factor;
 	m_webp_config.alpha_quality		= config.n_alpha_quality;
 	m_webp_config.lossless			= config.b_use_lossless_image_compression;
@@ -298,159 +528,593 @@ bool WebpEncoder::InitEncoder( ImageCompressionProperties	&config )
 	m_webp_config.filter_strength	= 0;
 
 	m_webp_config.near_lossless		= false;
-	m_webp_config.thread_level		= 1;
+	m_webp_config.thread_level		= config.b_use_parallel_processing ? 1 : 0;		// lets libwebp run its analysis and filter passes on a second thread
 
-	WebPPreset preset = WEBP_PRESET_TEXT;
-	
-	if (!WebPConfigPreset(&m_webp_config, preset, m_webp_config.quality)) 
+	// rate control: libwebp searches the quantizer over several passes on the same imported picture until the size or PSNR target is reached
+
+	const size_t n_target_size		= config.n_target_size ? config.n_target_size : (size_t)config.n_bit_rate * 1000 / 8;
+
+	m_webp_config.target_size		= (int)(n_target_size < (size_t)INT_MAX ? n_target_size : (size_t)INT_MAX);
+	m_webp_config.target_PSNR		= n_target_size ? 0.f : config.f_target_psnr;
+
+	b_rate_control					= !config.b_use_lossless_image_compression && (m_webp_config.target_size > 0 || m_webp_config.target_PSNR > 0);
+
+	if (b_rate_control)
 	{
-		return false;
+		m_webp_config.pass			= config.n_rate_control_passes;
+	}
+	else if (n_target_size || config.f_target_psnr > 0)
+	{
+		TRACE(_T("Warning! Rate control is ignored in lossless mode"));
 	}
+
+	m_last_rate_control				= WebpRateControlResult();
+
+	b_collect_stats					= config.b_collect_stats;
+
+	m_last_stats					= WebpEncodeStats();
 	
 	if (!WebPValidateConfig(&m_webp_config)) 
 	{
 		return false;
 	}
 
+	b_config_valid					= true;
+
 #endif
 
 	return true;
 }
 
-#ifdef _UNIT_TEST_WEBP
+/*
+* Instruction set the kernels and libwebp run with: the CPU's best, capped by the ceiling of the last SetInstructionSetCeiling
+*/
+WEBP_KERNEL_ISA WebpEncoder::GetInstructionSet( )
+{
+	return WebpGetActiveIsa();
+}
 
-bool WebpEncoder::EncodeImageFromTestFile( _In_ const char *in_file, _Inout_ std::vector<char> &out_img, _Inout_ size_t &output_size )
+/*
+* Returns true once InitEncoder has produced a valid config for this instance
+*/
+bool WebpEncoder::IsInitialized( ) const
 {
-		bool result						= true;
+	return b_config_valid;
+}
 
-		bool keep_metadata				= false;
+#ifdef _USE_WEBP_
 
-		Metadata metadata; 
-		MetadataInit(&metadata);
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Converts the RGB input to the picture's YUV planes. Large pictures are converted in horizontal bands on the encoder's pool, the bands start on even
+// rows so the 2x2 chroma averaging sees exactly the same pixels as a single import and the result is bit identical.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-		int									return_value = false;
+static const int												kParallelImportMinPixels = 1024 * 1024;
 
-		WebPPicture							picture;
-		WebPMemoryWriter					memory_writer;
+typedef int (*WebpImportFunction)(WebPPicture* picture, const uint8_t* data, int stride);
 
-		WebPMemoryWriterInit(&memory_writer);
-		
-		if (!WebPPictureInit(&picture))
-		{
-			TRACE(_T("Error! Version mismatch!"));
-			return false;
-		}
-		
-		// Read the input. We need to decide if we prefer ARGB or YUVA
-		// samples, depending on the expected compression mode (this saves
-		// some conversion steps).
+static bool IsPlanarYUV( IMG_PIXEL_FORMATS pixel_format )
+{
+	return pixel_format == PIXEL_FORMAT_YUV420 || pixel_format == PIXEL_FORMAT_YUVA420;
+}
 
-		if (!ReadPicture(in_file, &picture, true, false == keep_metadata ? NULL : &metadata)) 
-		{
-			TRACE(_T("Error! Cannot read input picture file "));
-			goto Error;
-		}
-		  
-		picture.use_argb				= false;
+static bool HasAlphaChannel( IMG_PIXEL_FORMATS pixel_format )
+{
+	return pixel_format == PIXEL_FORMAT_RGBA || pixel_format == PIXEL_FORMAT_BGRA || pixel_format == PIXEL_FORMAT_ARGB
+		|| pixel_format == PIXEL_FORMAT_RGBA_PREMULTIPLIED || pixel_format == PIXEL_FORMAT_YUVA420;
+}
 
-		picture.writer					= WebPMemoryWrite;
-		picture.custom_ptr				= (void*)&memory_writer;
-	
-#ifdef WEBP_PREPROCESS_IMAGE
+/*
+* libwebp import matching the input layout, NULL for the formats libwebp can't read directly. Inputs whose alpha isn't kept go through
+* the X variants, which skip the alpha plane altogether.
+*/
+static WebpImportFunction GetImportFunction( IMG_PIXEL_FORMATS pixel_format, bool b_keep_alpha )
+{
+	switch (pixel_format)
+	{
+	case PIXEL_FORMAT_RGB:		return WebPPictureImportRGB;
+	case PIXEL_FORMAT_RGBA:		return b_keep_alpha ? WebPPictureImportRGBA : WebPPictureImportRGBX;
+	case PIXEL_FORMAT_RGBX:		return WebPPictureImportRGBX;
+	case PIXEL_FORMAT_BGR:		return WebPPictureImportBGR;
+	case PIXEL_FORMAT_BGRA:		return b_keep_alpha ? WebPPictureImportBGRA : WebPPictureImportBGRX;
+	case PIXEL_FORMAT_BGRX:		return WebPPictureImportBGRX;
+	default:					return NULL;
+	}
+}
 
-		if (b_blend_alpha) 
+/*
+* Channel positions of the packed formats the picture pool converts itself
+*/
+static bool GetPackedLayout( IMG_PIXEL_FORMATS pixel_format, bool b_keep_alpha, WebpPackedLayout &layout )
+{
+	switch (pixel_format)
+	{
+	case PIXEL_FORMAT_RGB:		{ WebpPackedLayout l = { 3, 0, 1, 2, -1 }; layout = l; } break;
+	case PIXEL_FORMAT_RGBA:		{ WebpPackedLayout l = { 4, 0, 1, 2,  3 }; layout = l; } break;
+	case PIXEL_FORMAT_RGBX:		{ WebpPackedLayout l = { 4, 0, 1, 2, -1 }; layout = l; } break;
+	case PIXEL_FORMAT_BGR:		{ WebpPackedLayout l = { 3, 2, 1, 0, -1 }; layout = l; } break;
+	case PIXEL_FORMAT_BGRA:		{ WebpPackedLayout l = { 4, 2, 1, 0,  3 }; layout = l; } break;
+	case PIXEL_FORMAT_BGRX:		{ WebpPackedLayout l = { 4, 2, 1, 0, -1 }; layout = l; } break;
+	case PIXEL_FORMAT_ARGB:		{ WebpPackedLayout l = { 4, 1, 2, 3,  0 }; layout = l; } break;
+	default:					return false;
+	}
+
+	if (!b_keep_alpha)
+	{
+		layout.n_a = -1;
+	}
+
+	return true;
+}
+
+/*
+* ARGB and premultiplied RGBA bytes have no libwebp import, they are written straight into the picture's ARGB plane and libwebp
+* converts them to YUV itself if the encode is lossy. The ARGB words are little endian, so each pixel becomes B, G, R, A in memory.
+*/
+static bool ImportToARGB( WebPPicture *picture, const uint8_t* in_image, int stride, IMG_PIXEL_FORMATS pixel_format, bool b_keep_alpha )
+{
+	static const uint8_t			kFromARGB[4] = { 3, 2, 1, 0 };
+	static const uint8_t			kFromRGBA[4] = { 2, 1, 0, 3 };
+
+	const WebpPixelKernels			*kernels = WebpGetPixelKernels();
+
+	const bool						b_premultiplied = (pixel_format == PIXEL_FORMAT_RGBA_PREMULTIPLIED);
+
+	picture->use_argb = true;
+
+	if (!WebPPictureAlloc(picture))
+	{
+		return false;
+	}
+
+	for (int y = 0; y < picture->height; ++y)
+	{
+		const uint8_t	*src = in_image + (size_t)y * stride;
+		uint32_t		*dst = picture->argb + (size_t)y * picture->argb_stride;
+
+		kernels->ptr_shuffle(src, (uint8_t*)dst, picture->width, b_premultiplied ? kFromRGBA : kFromARGB);
+
+		if (b_premultiplied)
 		{
-			WebPBlendAlpha(&picture, background_color);
+			kernels->ptr_unpremultiply((uint8_t*)dst, picture->width);
 		}
-		
-		if (b_crop)
+
+		if (!b_keep_alpha)
 		{
-			// We use self-cropping using a view.
-			if (!WebPPictureView(&picture, crop_x, crop_y, crop_w, crop_h, &picture)) 
-			{
-				TRACE(_T("Error! Cannot crop picture"));
-				goto Error;
-			}
+			kernels->ptr_fill_alpha(dst, picture->width);
 		}
-		
-		if (b_scale)
-		{
-			if ((resize_w | resize_h) > 0) 
-			{
-				if (!WebPPictureRescale(&picture, resize_w, resize_h)) 
-				{
-					TRACE(_T("Error! Cannot resize picture"));
-					goto Error;
-				}
+	}
+
+	return true;
+}
+
+/*
+* Row size of a tightly packed input
+*/
+unsigned int WebpEncoder::GetDefaultStride( _In_ IMG_PIXEL_FORMATS pixel_format, _In_ unsigned int width, _In_ unsigned int n_bytes_per_pixel )
+{
+	if (IsPlanarYUV(pixel_format))
+	{
+		return width;
+	}
+
+	return width * n_bytes_per_pixel;
+}
+
+/*
+* Caps the SIMD level of our kernels and of libwebp's DSP functions for the whole process. Not tied to an encoder instance, so call it once
+* before the first encode rather than from code that runs per image.
+*/
+void WebpEncoder::SetInstructionSetCeiling( _In_ WEBP_KERNEL_ISA n_ceiling )
+{
+	WebpSetIsaCeiling(n_ceiling);
+}
+
+/*
+* Size of one input pixel, the Y plane of planar YUV has one byte per pixel
+*/
+unsigned int WebpEncoder::GetInputBytesPerPixel( _In_ IMG_PIXEL_FORMATS pixel_format )
+{
+	switch (pixel_format)
+	{
+	case PIXEL_FORMAT_RGB:
+	case PIXEL_FORMAT_BGR:					return 3;
+	case PIXEL_FORMAT_RGBA:
+	case PIXEL_FORMAT_RGBX:
+	case PIXEL_FORMAT_BGRA:
+	case PIXEL_FORMAT_BGRX:
+	case PIXEL_FORMAT_ARGB:
+	case PIXEL_FORMAT_RGBA_PREMULTIPLIED:	return 4;
+	case PIXEL_FORMAT_YUV420:
+	case PIXEL_FORMAT_YUVA420:				return 1;
+	default:								return 0;		// RGB565 and RGBA4444 are decoder output formats only
+	}
+}
+
+WebpPicturePool* WebpEncoder::GetPicturePool( )
+{
+	if (!m_picture_pool && n_picture_pool_bytes)
+	{
+		m_picture_pool = new WebpPicturePool(n_picture_pool_bytes);
+	}
+
+	return m_picture_pool;
+}
+
+/*
+* Takes a picture with ready planes from the pool, NULL when the pool is off, the input is planar or premultiplied, or the picture will be
+* cropped/rescaled in place
+*/
+WebPPicture* WebpEncoder::AcquirePooledPicture( _In_ unsigned int width, _In_ unsigned int height )
+{
+	WebpPackedLayout					layout;
+
+	if (b_crop || b_scale || !GetPackedLayout(n_pixel_format, b_keep_alpha, layout) || !GetPicturePool())
+	{
+		return NULL;
+	}
+
+	return m_picture_pool->Acquire(width, height, layout.n_a >= 0, m_webp_config.lossless != 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Points the picture at the caller's planes, nothing is copied for I420. libwebp wants separate U and V planes, so NV12 chroma is split into
+// 'scratch' which keeps its memory from one frame to the next; the picture points into it until the encode is done, so every thread that
+// encodes needs its own (m_plane_scratch, or the batch worker's). With alpha, libwebp rewrites the colour under fully transparent pixels
+// (unless the config is exact) and alpha blending rewrites every plane, so then all planes are copied and the caller's frame stays untouched.
+// WebPPictureFree only releases what libwebp allocated itself, the planes stay with the caller.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void CopyPlane( _In_ const uint8_t* src, _In_ size_t src_stride, _Inout_ uint8_t* dst, _In_ int width, _In_ int height )
+{
+	for (int y = 0; y < height; ++y)
+	{
+		memcpy(dst + (size_t)y * width, src + (size_t)y * src_stride, (size_t)width);
+	}
+}
+
+bool WebpEncoder::AttachYUVPlanes( _Inout_ WebPPicture *picture, _In_ const WebpYUVPlanes &planes, _Inout_ std::vector<uint8_t> &scratch )
+{
+	const int							width		= (int)planes.n_width;
+	const int							height		= (int)planes.n_height;
+	const int							uv_width	= (width + 1) >> 1;
+	const int							uv_height	= (height + 1) >> 1;
+	const bool							b_nv12		= (planes.n_layout == WEBP_YUV_LAYOUT_NV12);
+	const bool							b_alpha		= b_keep_alpha && planes.p_a != NULL;
+	const bool							b_copy		= b_alpha && (!m_webp_config.exact || b_blend_alpha);
+
+	if (width <= 0 || height <= 0 || !planes.p_y || !planes.p_u || (!b_nv12 && !planes.p_v))
+	{
+		picture->error_code = (width <= 0 || height <= 0) ? VP8_ENC_ERROR_BAD_DIMENSION : VP8_ENC_ERROR_NULL_PARAMETER;
+		return false;
+	}
+
+	if (planes.n_y_stride < planes.n_width || planes.n_uv_stride < (unsigned int)(b_nv12 ? 2 * uv_width : uv_width) || (b_alpha && planes.n_a_stride < planes.n_width))
+	{
+		picture->error_code = VP8_ENC_ERROR_INVALID_CONFIGURATION;
+		return false;
+	}
+
+	picture->use_argb					= false;
+	picture->width						= width;
+	picture->height						= height;
+	picture->colorspace					= b_alpha ? WEBP_YUV420A : WEBP_YUV420;
+
+	if (!b_nv12 && !b_copy)
+	{
+		picture->y						= const_cast<uint8_t*>(planes.p_y);		// encoded in place, libwebp doesn't write to them
+		picture->y_stride				= (int)planes.n_y_stride;
+		picture->u						= const_cast<uint8_t*>(planes.p_u);
+		picture->v						= const_cast<uint8_t*>(planes.p_v);
+		picture->uv_stride				= (int)planes.n_uv_stride;
+		picture->a						= b_alpha ? const_cast<uint8_t*>(planes.p_a) : NULL;
+		picture->a_stride				= b_alpha ? (int)planes.n_a_stride : 0;
+
+		return true;
+	}
+
+	const size_t						y_size	= b_copy ? (size_t)width * height : 0;
+	const size_t						uv_size	= (size_t)uv_width * uv_height;
+
+	scratch.resize(2 * (y_size + uv_size));		// the alpha plane has the size of the Y plane
+
+	uint8_t								*u = &scratch[y_size];
+	uint8_t								*v = u + uv_size;
+
+	if (b_nv12)
+	{
+		for (int y = 0; y < uv_height; ++y)
+		{
+			const uint8_t				*src = planes.p_u + (size_t)y * planes.n_uv_stride;
+
+			for (int x = 0; x < uv_width; ++x)
+			{
+				u[(size_t)y * uv_width + x] = src[2 * x];
+				v[(size_t)y * uv_width + x] = src[2 * x + 1];
 			}
 		}
+	}
+	else
+	{
+		CopyPlane(planes.p_u, planes.n_uv_stride, u, uv_width, uv_height);
+		CopyPlane(planes.p_v, planes.n_uv_stride, v, uv_width, uv_height);
+	}
 
-#endif
+	picture->u							= u;
+	picture->v							= v;
+	picture->uv_stride					= uv_width;
 
-		// Compress.
-		if (!WebPEncode(&m_webp_config, &picture)) 
+	if (b_copy)
+	{
+		uint8_t							*a = v + uv_size;
+
+		CopyPlane(planes.p_y, planes.n_y_stride, &scratch[0], width, height);
+		CopyPlane(planes.p_a, planes.n_a_stride, a, width, height);
+
+		picture->y						= &scratch[0];
+		picture->y_stride				= width;
+		picture->a						= a;
+		picture->a_stride				= width;
+	}
+	else
+	{
+		picture->y						= const_cast<uint8_t*>(planes.p_y);
+		picture->y_stride				= (int)planes.n_y_stride;
+		picture->a						= b_alpha ? const_cast<uint8_t*>(planes.p_a) : NULL;
+		picture->a_stride				= b_alpha ? (int)planes.n_a_stride : 0;
+	}
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Routes the input to the cheapest import for its pixel format: planar YUV is attached as is, packed RGB/BGR go through the matching libwebp
+// import (or our converter for pooled pictures), ARGB and premultiplied RGBA are written to the ARGB plane.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WebpEncoder::ImportPicture( _Inout_ WebPPicture *picture, _In_ const uint8_t* in_image, _In_ int stride, _In_ unsigned int n_bytes_per_pixel, _In_ bool b_allow_parallel, _In_ bool b_pooled, _Inout_ std::vector<uint8_t> *p_plane_scratch )
+{
+	const bool b_parallel = b_allow_parallel && n_worker_threads > 1 && picture->width * picture->height >= kParallelImportMinPixels;
+
+	if (!in_image || n_bytes_per_pixel == 0 || n_bytes_per_pixel != GetInputBytesPerPixel(n_pixel_format) || stride <= 0 || (size_t)stride < (size_t)picture->width * n_bytes_per_pixel)
+	{
+		TRACE(_T("Error! Stride or bytes per pixel don't match the pixel format"));
+		picture->error_code = in_image ? VP8_ENC_ERROR_INVALID_CONFIGURATION : VP8_ENC_ERROR_NULL_PARAMETER;
+		return false;
+	}
+
+	if (b_pooled)
+	{
+		WebpPackedLayout					layout;
+
+		if (!GetPackedLayout(n_pixel_format, b_keep_alpha, layout))
 		{
-			TRACE(_T("Error! Cannot encode picture as WebP Error code: %d (%s)"), picture.error_code, kErrorMessages[picture.error_code]);
-			goto Error;
+			picture->error_code = VP8_ENC_ERROR_INVALID_CONFIGURATION;
+			return false;
 		}
 
-		output_size					= memory_writer.size;
+		if (!b_parallel)
+		{
+			if (!WebpPicturePool::ImportPackedRows(picture, in_image, stride, layout, 0, picture->height))
+			{
+				picture->error_code = VP8_ENC_ERROR_INVALID_CONFIGURATION;
+				return false;
+			}
 
-		out_img.assign(memory_writer.mem, memory_writer.mem  + output_size);
+			return true;
+		}
 
-		return_value = true;
+		WebpThreadPool						*pool = GetThreadPool();
 
-Error:
-		WebPMemoryWriterClear(&memory_writer);
-		MetadataFree(&metadata);
-		WebPPictureFree(&picture);
+		const int							n_bands = (int)pool->GetThreadCount() * 2;
+		const int							band_rows = (((picture->height + n_bands - 1) / n_bands) + 1) & ~1;
 
-		return return_value;
-}
+		std::atomic<bool>					b_failed(false);
 
+		pool->ParallelFor((size_t)((picture->height + band_rows - 1) / band_rows), [&](size_t n_band, unsigned int)
+		{
+			if (!WebpPicturePool::ImportPackedRows(picture, in_image, stride, layout, (int)n_band * band_rows, band_rows))
+			{
+				b_failed = true;
+			}
+		});
 
-bool WebpEncoder::EncodeImage( _In_ uint8_t* in_image, _In_ unsigned int width, _In_ unsigned int height, _In_ unsigned int	n_bytes_per_pixel, _In_ float f_quality_factor, _Inout_ std::vector<char> &out_img, _Inout_ size_t &output_size )
+		if (b_failed)
+		{
+			picture->error_code = VP8_ENC_ERROR_INVALID_CONFIGURATION;
+		}
+
+		return !b_failed;
+	}
+
+	if (IsPlanarYUV(n_pixel_format))
+	{
+		// contiguous I420, the chroma planes follow the Y plane and the alpha plane comes last
+
+		WebpYUVPlanes					planes;
+
+		const size_t					y_size	= (size_t)stride * picture->height;
+		const size_t					uv_size	= (size_t)((stride + 1) >> 1) * ((picture->height + 1) >> 1);
+
+		planes.n_width					= picture->width;
+		planes.n_height					= picture->height;
+		planes.p_y						= in_image;
+		planes.p_u						= in_image + y_size;
+		planes.p_v						= in_image + y_size + uv_size;
+		planes.p_a						= (n_pixel_format == PIXEL_FORMAT_YUVA420) ? in_image + y_size + 2 * uv_size : NULL;
+		planes.n_y_stride				= stride;
+		planes.n_uv_stride				= (stride + 1) >> 1;
+		planes.n_a_stride				= stride;
+
+		return AttachYUVPlanes(picture, planes, p_plane_scratch ? *p_plane_scratch : m_plane_scratch);
+	}
+
+	WebpImportFunction					ptr_import = GetImportFunction(n_pixel_format, b_keep_alpha);
+
+	if (!ptr_import)
+	{
+		if (n_pixel_format != PIXEL_FORMAT_ARGB && n_pixel_format != PIXEL_FORMAT_RGBA_PREMULTIPLIED)
+		{
+			picture->error_code = VP8_ENC_ERROR_INVALID_CONFIGURATION;
+			return false;		// RGB565 and RGBA4444 are decoder output formats only
+		}
+
+		return ImportToARGB(picture, in_image, stride, n_pixel_format, b_keep_alpha);
+	}
+
+	if (b_parallel && !picture->use_argb)
+	{
+		return ImportPictureParallel(picture, in_image, stride, ptr_import);
+	}
+
+	return ptr_import(picture, in_image, stride) != 0;
+}
+
+bool WebpEncoder::ImportPictureParallel( _Inout_ WebPPicture *picture, _In_ const uint8_t* in_image, _In_ int stride, _In_ int (*ptr_import)(WebPPicture*, const uint8_t*, int) )
 {
-	bool result = true;
+	const bool							b_alpha_input = b_keep_alpha && HasAlphaChannel(n_pixel_format);
 
-	if (ptr_encode_image)
+	picture->colorspace					= b_alpha_input ? WEBP_YUV420A : WEBP_YUV420;
+
+	if (!WebPPictureAlloc(picture))
 	{
-		uint8_t *lpByte = NULL;
+		return false;
+	}
 
-		output_size = ptr_encode_image(in_image, width, height, width * n_bytes_per_pixel, f_quality_factor, &lpByte);
+	WebpThreadPool						*pool = GetThreadPool();
 
+	const int							n_bands = (int)pool->GetThreadCount() * 2;		// a few spare bands for the faster workers to steal
+	const int							band_rows = (((picture->height + n_bands - 1) / n_bands) + 1) & ~1;
+	const int							n_used_bands = (picture->height + band_rows - 1) / band_rows;
 
-		if (lpByte)
+	std::atomic<bool>					b_failed(false);
+	std::atomic<bool>					b_any_alpha(false);
+
+	pool->ParallelFor((size_t)n_used_bands, [&](size_t n_band, unsigned int)
+	{
+		const int	y0		= (int)n_band * band_rows;
+		const int	rows	= (y0 + band_rows <= picture->height) ? band_rows : picture->height - y0;
+
+		WebPPicture	band;
+
+		if (!WebPPictureInit(&band))
 		{
-			out_img.assign(lpByte, lpByte + output_size);
+			b_failed = true;
+			return;
+		}
 
-			WebPFree(lpByte);
+		band.use_argb	= false;
+		band.width		= picture->width;
+		band.height		= rows;
+
+		if (!ptr_import(&band, in_image + (size_t)y0 * stride, stride))
+		{
+			b_failed = true;
+			return;
 		}
-		else
+
+		const int	uv_width	= (picture->width + 1) >> 1;
+		const int	uv_rows		= (rows + 1) >> 1;
+
+		for (int y = 0; y < rows; ++y)
 		{
-			result = false;
+			memcpy(picture->y + (size_t)(y0 + y) * picture->y_stride, band.y + (size_t)y * band.y_stride, picture->width);
+		}
+
+		for (int y = 0; y < uv_rows; ++y)
+		{
+			memcpy(picture->u + (size_t)((y0 >> 1) + y) * picture->uv_stride, band.u + (size_t)y * band.uv_stride, uv_width);
+			memcpy(picture->v + (size_t)((y0 >> 1) + y) * picture->uv_stride, band.v + (size_t)y * band.uv_stride, uv_width);
+		}
+
+		if (picture->a)
+		{
+			// libwebp leaves the alpha plane out of bands that are fully opaque
+
+			for (int y = 0; y < rows; ++y)
+			{
+				uint8_t *dst = picture->a + (size_t)(y0 + y) * picture->a_stride;
+
+				if (band.a)
+				{
+					memcpy(dst, band.a + (size_t)y * band.a_stride, picture->width);
+				}
+				else
+				{
+					memset(dst, 0xff, picture->width);
+				}
+			}
+
+			if (band.a)
+			{
+				b_any_alpha = true;
+			}
 		}
+
+		WebPPictureFree(&band);
+	});
+
+	if (b_failed)
+	{
+		picture->error_code				= VP8_ENC_ERROR_OUT_OF_MEMORY;		// the bands only fail to allocate, their own error code is gone with them
+		return false;
 	}
-	else
+
+	if (picture->a && !b_any_alpha)
 	{
-		result = false;
+		picture->colorspace				= WEBP_YUV420;		// same as a single import of an opaque image
+		picture->a						= NULL;
+		picture->a_stride				= 0;
 	}
 
-	return result;
+	return !b_failed;
 }
 
-bool WebpEncoder::EncodeImageAndWriteToFile(
-																_In_					uint8_t*													in_image, 
-																_In_					unsigned int														width, 
-																_In_					unsigned int														height, 
-																_In_					unsigned int														n_bytes_per_pixel,
-																_In_					const char*													out_file
-							  )
+#ifdef WEBP_PREPROCESS_IMAGE
+
+/*
+* WebPBlendAlpha over the pixel kernels for ARGB pictures, same rounding so the output doesn't change. YUV pictures still go through libwebp,
+* its blend works on the subsampled planes.
+*/
+static void BlendAlpha( _Inout_ WebPPicture *picture, _In_ uint32_t background_color )
 {
-		int									return_value = false;
+	if (!picture->use_argb)
+	{
+		WebPBlendAlpha(picture, background_color);
+
+		return;
+	}
 
+	const WebpPixelKernels			*kernels = WebpGetPixelKernels();
 
-#ifdef _USE_WEBP_
+	for (int y = 0; y < picture->height; ++y)
+	{
+		kernels->ptr_blend_to_background((uint8_t*)(picture->argb + (size_t)y * picture->argb_stride), picture->width, background_color);
+	}
+}
+
+#endif
+
+#endif
+
+#ifdef _UNIT_TEST_WEBP
+
+bool WebpEncoder::EncodeImageFromTestFile( _In_ const char *in_file, _Inout_ std::vector<char> &out_img, _Inout_ size_t &output_size )
+{
+		bool result						= true;
+
+		bool keep_metadata				= false;
+
+		Metadata metadata; 
+		MetadataInit(&metadata);
+
+		int									return_value = false;
 
 		WebPPicture							picture;
 		WebPMemoryWriter					memory_writer;
@@ -466,30 +1130,23 @@ bool WebpEncoder::EncodeImageAndWriteToFile(
 		// Read the input. We need to decide if we prefer ARGB or YUVA
 		// samples, depending on the expected compression mode (this saves
 		// some conversion steps).
-		  
-		picture.use_argb				= false;
-		picture.width					= width;
-		picture.height					= height;
 
-		FILE *out = fopen(out_file, "wb");
-
-		if (!out)
+		if (!ReadPicture(in_file, &picture, true, false == keep_metadata ? NULL : &metadata)) 
 		{
-			return false;
+			TRACE(_T("Error! Cannot read input picture file "));
+			goto Error;
 		}
-		
-		picture.writer = MyWriter;
-		picture.custom_ptr = (void*)out;
-
-		WebPPictureImportRGBX(&picture, in_image, width * n_bytes_per_pixel);   // convert from RGB to internal YUV
+		  
+		picture.use_argb				= false;
 
-		//WebPPictureSharpARGBToYUVA(&picture);
+		picture.writer					= WebPMemoryWrite;
+		picture.custom_ptr				= (void*)&memory_writer;
 	
 #ifdef WEBP_PREPROCESS_IMAGE
 
 		if (b_blend_alpha) 
 		{
-			WebPBlendAlpha(&picture, background_color);
+			BlendAlpha(&picture, background_color);
 		}
 		
 		if (b_crop)
@@ -523,34 +1180,70 @@ bool WebpEncoder::EncodeImageAndWriteToFile(
 			goto Error;
 		}
 
+		output_size					= memory_writer.size;
+
+		out_img.assign(memory_writer.mem, memory_writer.mem  + output_size);
+
 		return_value = true;
 
 Error:
 		WebPMemoryWriterClear(&memory_writer);
+		MetadataFree(&metadata);
 		WebPPictureFree(&picture);
 
-		fclose(out);
-
-#endif
-
 		return return_value;
 }
 
-#endif
 
-bool WebpEncoder::EncodeImage(
+bool WebpEncoder::EncodeImage( _In_ uint8_t* in_image, _In_ unsigned int width, _In_ unsigned int height, _In_ unsigned int	n_bytes_per_pixel, _In_ float f_quality_factor, _Inout_ std::vector<char> &out_img, _Inout_ size_t &output_size )
+{
+	bool result = true;
+
+	if (ptr_encode_image)
+	{
+		uint8_t *lpByte = NULL;
+
+		output_size = ptr_encode_image(in_image, width, height, width * n_bytes_per_pixel, f_quality_factor, &lpByte);
+
+
+		if (lpByte)
+		{
+			out_img.assign(lpByte, lpByte + output_size);
+
+			WebPFree(lpByte);
+		}
+		else
+		{
+			result = false;
+		}
+	}
+	else
+	{
+		result = false;
+	}
+
+	return result;
+}
+
+bool WebpEncoder::EncodeImageAndWriteToFile(
 																_In_					uint8_t*													in_image, 
 																_In_					unsigned int														width, 
 																_In_					unsigned int														height, 
-																_In_					unsigned int														n_bytes_per_pixel, 	
-																_Inout_					std::vector<char>											&imgData, 
-																_Inout_					size_t														&output_size 
+																_In_					unsigned int														n_bytes_per_pixel,
+																_In_					const char*													out_file
 							  )
 {
 		int									return_value = false;
 
+
 #ifdef _USE_WEBP_
 
+		if (!b_config_valid)
+		{
+			TRACE(_T("Error! Encoder is not initialized"));
+			return false;
+		}
+
 		WebPPicture							picture;
 		WebPMemoryWriter					memory_writer;
 
@@ -570,10 +1263,21 @@ bool WebpEncoder::EncodeImage(
 		picture.width					= width;
 		picture.height					= height;
 
-		picture.writer					= WebPMemoryWrite;
-		picture.custom_ptr				= (void*)&memory_writer;
+		FILE *out = fopen(out_file, "wb");
+
+		if (!out)
+		{
+			return false;
+		}
+		
+		picture.writer = MyWriter;
+		picture.custom_ptr = (void*)out;
 
-		WebPPictureImportRGBX(&picture, in_image, width * n_bytes_per_pixel);   // convert from RGB to internal YUV
+		if (!ImportPicture(&picture, in_image, GetDefaultStride(n_pixel_format, width, n_bytes_per_pixel), n_bytes_per_pixel, true, false))   // convert from RGB to internal YUV
+		{
+			TRACE(_T("Error! Cannot import picture"));
+			goto Error;
+		}
 
 		//WebPPictureSharpARGBToYUVA(&picture);
 	
@@ -581,7 +1285,7 @@ bool WebpEncoder::EncodeImage(
 
 		if (b_blend_alpha) 
 		{
-			WebPBlendAlpha(&picture, background_color);
+			BlendAlpha(&picture, background_color);
 		}
 		
 		if (b_crop)
@@ -606,10 +1310,6 @@ bool WebpEncoder::EncodeImage(
 			}
 		}
 
-#endif
-		
-#ifdef _PRINT_IMG_CONVERSION_TIME
-		unsigned long long conversion_start_time = GetCurrentTimeMillis();
 #endif
 
 		// Compress.
@@ -619,17 +1319,1255 @@ bool WebpEncoder::EncodeImage(
 			goto Error;
 		}
 
-		output_size					= memory_writer.size;
-
-		imgData.assign(memory_writer.mem, memory_writer.mem  + output_size);
-
 		return_value = true;
 
 Error:
 		WebPMemoryWriterClear(&memory_writer);
 		WebPPictureFree(&picture);
 
+		fclose(out);
+
+#endif
+
+		return return_value;
+}
+
 #endif
 
+#ifdef _USE_WEBP_
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Imports and encodes one image, the bitstream goes straight to 'writer' so every output mode shares this path
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WebpEncoder::EncodeToWriter(
+																_In_					const uint8_t*												in_image, 
+																_In_					unsigned int														width, 
+																_In_					unsigned int														height, 
+																_In_					unsigned int														n_bytes_per_pixel, 	
+																_In_					int																	stride, 	
+																_In_					WebPWriterFunction											writer, 
+																_In_					void*														custom_ptr 
+							  )
+{
+		int									return_value = false;
+
+		if (!b_config_valid)
+		{
+			TRACE(_T("Error! Encoder is not initialized"));
+			return false;
+		}
+
+		WebPPicture							local_picture;
+		
+		if (!WebPPictureInit(&local_picture))
+		{
+			TRACE(_T("Error! Version mismatch!"));
+			return false;
+		}
+
+		WebPPicture							*pooled_picture = AcquirePooledPicture(width, height);
+
+		WebpEncodeStats						*p_stats = b_collect_stats ? &m_last_stats : NULL;
+
+		double								f_start_ms = 0;
+
+		WebPPicture							&picture = pooled_picture ? *pooled_picture : local_picture;
+		
+		// Read the input. We need to decide if we prefer ARGB or YUVA
+		// samples, depending on the expected compression mode (this saves
+		// some conversion steps).
+
+		if (!pooled_picture)
+		{
+			picture.use_argb			= false;
+			picture.width				= width;
+			picture.height				= height;
+		}
+
+		picture.writer					= writer;
+		picture.custom_ptr				= custom_ptr;
+
+		if (p_stats)
+		{
+			*p_stats					= WebpEncodeStats();
+
+			f_start_ms					= GetTimeMs();
+		}
+
+		{
+			WEBP_METRICS_START(n_import_start);
+
+			const bool					b_imported = ImportPicture(&picture, in_image, stride, n_bytes_per_pixel, true, pooled_picture != NULL);   // convert from RGB to internal YUV
+
+			WEBP_METRICS_RECORD(WEBP_METRIC_OP_IMPORT, n_import_start, (uint64_t)width * height, (uint64_t)stride * height, 0, b_imported ? 0 : (int)picture.error_code);
+
+			if (!b_imported)
+			{
+				TRACE(_T("Error! Cannot import picture"));
+				goto Error;
+			}
+		}
+
+		if (p_stats)
+		{
+			p_stats->f_import_ms		= GetTimeMs() - f_start_ms;
+		}
+
+		if (!EncodePicture(picture, p_stats, b_rate_control ? &m_last_rate_control : NULL))
+		{
+			goto Error;
+		}
+
+		if (p_stats)
+		{
+			p_stats->f_total_ms			= GetTimeMs() - f_start_ms;
+		}
+
+		return_value = true;
+
+Error:
+		if (pooled_picture)
+		{
+			m_picture_pool->Release(pooled_picture);
+		}
+		else
+		{
+			WebPPictureFree(&picture);
+		}
+
+		return return_value;
+}
+
+/*
+* Encodes a frame which is already YUV 4:2:0, the picture only points at the caller's planes
+*/
+bool WebpEncoder::EncodeYUVToWriter(
+																_In_					const WebpYUVPlanes											&planes, 
+																_In_					WebPWriterFunction											writer, 
+																_In_					void*														custom_ptr 
+							  )
+{
+		int									return_value = false;
+
+		if (!b_config_valid)
+		{
+			TRACE(_T("Error! Encoder is not initialized"));
+			return false;
+		}
+
+		WebpEncodeStats						*p_stats = b_collect_stats ? &m_last_stats : NULL;
+
+		double								f_start_ms = 0;
+
+		WebPPicture							picture;
+		
+		if (!WebPPictureInit(&picture))
+		{
+			TRACE(_T("Error! Version mismatch!"));
+			return false;
+		}
+
+		picture.writer					= writer;
+		picture.custom_ptr				= custom_ptr;
+
+		if (p_stats)
+		{
+			*p_stats					= WebpEncodeStats();
+
+			f_start_ms					= GetTimeMs();
+		}
+
+		{
+			WEBP_METRICS_START(n_import_start);
+
+			const bool					b_attached = AttachYUVPlanes(&picture, planes, m_plane_scratch);
+
+			WEBP_METRICS_RECORD(WEBP_METRIC_OP_IMPORT, n_import_start, (uint64_t)planes.n_width * planes.n_height, (uint64_t)planes.n_y_stride * planes.n_height, 0, b_attached ? 0 : VP8_ENC_ERROR_INVALID_CONFIGURATION);
+
+			if (!b_attached)
+			{
+				TRACE(_T("Error! Invalid YUV planes"));
+				goto Error;
+			}
+		}
+
+		if (p_stats)
+		{
+			p_stats->f_import_ms		= GetTimeMs() - f_start_ms;		// only the NV12 chroma split takes any time
+		}
+
+		if (!EncodePicture(picture, p_stats, b_rate_control ? &m_last_rate_control : NULL))
+		{
+			goto Error;
+		}
+
+		if (p_stats)
+		{
+			p_stats->f_total_ms			= GetTimeMs() - f_start_ms;
+		}
+
+		return_value = true;
+
+Error:
+		WebPPictureFree(&picture);		// only frees what libwebp allocated, e.g. the ARGB copy of a lossless encode
+
 		return return_value;
-}
\ No newline at end of file
+}
+
+/*
+* What the rate control search reached compared with its target
+*/
+static WebpRateControlResult MakeRateControlResult( const WebPConfig &config, const WebPAuxStats &aux_stats )
+{
+	WebpRateControlResult				result;
+
+	result.n_target_size				= (size_t)config.target_size;
+	result.f_target_psnr				= config.target_PSNR;
+	result.n_coded_size					= (size_t)aux_stats.coded_size;
+	result.f_psnr						= aux_stats.PSNR[3];
+	result.f_psnr_alpha					= aux_stats.PSNR[4];
+
+	result.b_target_met					= config.target_size > 0 ? (result.n_coded_size <= result.n_target_size) : (result.f_psnr >= result.f_target_psnr);
+
+	return result;
+}
+
+/*
+* Wraps the caller's writer so the time spent in it shows up as output time, not encode time, and counts the bytes for the metrics
+*/
+struct WebpTimedWriter
+{
+	WebPWriterFunction					writer;
+
+	void*								custom_ptr;
+
+	double								f_elapsed_ms;
+
+	uint64_t							n_bytes;
+};
+
+static int TimedWrite(const uint8_t* data, size_t data_size, const WebPPicture* const picture)
+{
+	WebpTimedWriter* const				timed = (WebpTimedWriter*)picture->custom_ptr;
+
+	WebPPicture							inner = *picture;		// the wrapped writer finds its own state in custom_ptr
+
+	inner.custom_ptr					= timed->custom_ptr;
+
+	const double						f_start_ms = GetTimeMs();
+
+	const int							ok = timed->writer(data, data_size, &inner);
+
+	timed->f_elapsed_ms					+= GetTimeMs() - f_start_ms;
+
+	timed->n_bytes						+= data_size;
+
+	return ok;
+}
+
+static void CopyAuxStats( const WebPAuxStats &aux_stats, WebpEncodeStats &stats )
+{
+	stats.n_coded_size					= (size_t)aux_stats.coded_size;
+
+	memcpy(stats.f_psnr, aux_stats.PSNR, sizeof(stats.f_psnr));
+	memcpy(stats.n_header_bytes, aux_stats.header_bytes, sizeof(stats.n_header_bytes));
+	memcpy(stats.n_residual_bytes, aux_stats.residual_bytes, sizeof(stats.n_residual_bytes));
+	memcpy(stats.n_segment_size, aux_stats.segment_size, sizeof(stats.n_segment_size));
+	memcpy(stats.n_segment_quant, aux_stats.segment_quant, sizeof(stats.n_segment_quant));
+	memcpy(stats.n_block_count, aux_stats.block_count, sizeof(stats.n_block_count));
+
+	stats.n_alpha_data_size				= aux_stats.alpha_data_size;
+	stats.n_lossless_features			= aux_stats.lossless_features;
+	stats.n_lossless_hdr_size			= aux_stats.lossless_hdr_size;
+	stats.n_lossless_data_size			= aux_stats.lossless_data_size;
+	stats.n_palette_size				= aux_stats.palette_size;
+	stats.n_cache_bits					= aux_stats.cache_bits;
+}
+
+/*
+* Size of the big buffers of an encode, worked out from the picture dimensions: the planes we hand libwebp, the ARGB copy and transform buffer
+* of a lossless encode or the reconstructed frame of a lossy one, and the bitstream. libwebp's allocations aren't observed, so this is neither
+* a measurement nor a true peak; smaller tables and the rate control or quality search copies aren't counted.
+*/
+static size_t EstimatePlaneBytes( const WebPPicture &picture, bool b_lossless, size_t n_coded_size )
+{
+	const size_t						n_argb_bytes = (size_t)picture.width * picture.height * sizeof(uint32_t);
+	const size_t						n_yuv_bytes = WebpPicturePool::GetPictureBytes(picture.width, picture.height, picture.a != NULL, false);
+
+	size_t								n_bytes = picture.use_argb ? n_argb_bytes : n_yuv_bytes;
+
+	if (b_lossless)
+	{
+		n_bytes += (picture.use_argb ? 0 : n_argb_bytes) + n_argb_bytes;
+	}
+	else
+	{
+		n_bytes += (picture.use_argb ? n_yuv_bytes : 0) + n_yuv_bytes;
+	}
+
+	return n_bytes + n_coded_size;
+}
+
+/*
+* Optional preprocessing then the actual compression of an imported picture, the picture's writer receives the bitstream. p_stats gets the
+* stage timings and libwebp's statistics, p_rate_control what the rate control reached; either may be NULL.
+*/
+bool WebpEncoder::EncodePicture( _Inout_ WebPPicture &picture, _Inout_ WebpEncodeStats *p_stats, _Inout_ WebpRateControlResult *p_rate_control )
+{
+		WebPAuxStats						aux_stats;
+
+		WebpTimedWriter						timed_writer;
+
+		double								f_start_ms = p_stats ? GetTimeMs() : 0;
+
+		bool								b_encoded;
+
+		WEBP_METRICS_START(n_metrics_start);
+
+		const bool							b_wrap_writer = p_stats || n_metrics_start;
+
+		//WebPPictureSharpARGBToYUVA(&picture);
+
+#ifdef WEBP_PREPROCESS_IMAGE
+
+		if (b_blend_alpha)
+		{
+			BlendAlpha(&picture, background_color);
+		}
+
+		if (b_crop)
+		{
+			// We use self-cropping using a view.
+			if (!WebPPictureView(&picture, crop_x, crop_y, crop_w, crop_h, &picture))
+			{
+				TRACE(_T("Error! Cannot crop picture"));
+				return false;
+			}
+		}
+
+		if (b_scale)
+		{
+			if ((resize_w | resize_h) > 0)
+			{
+				if (!WebPPictureRescale(&picture, resize_w, resize_h))
+				{
+					TRACE(_T("Error! Cannot resize picture"));
+					return false;
+				}
+			}
+		}
+
+#endif
+
+		if (p_stats)
+		{
+			p_stats->f_preprocess_ms		= GetTimeMs() - f_start_ms;
+			p_stats->b_lossless				= m_webp_config.lossless != 0;
+
+			f_start_ms						= GetTimeMs();
+		}
+
+		if (b_wrap_writer)
+		{
+			timed_writer.writer				= picture.writer;
+			timed_writer.custom_ptr			= picture.custom_ptr;
+			timed_writer.f_elapsed_ms		= 0;
+			timed_writer.n_bytes			= 0;
+
+			picture.writer					= TimedWrite;
+			picture.custom_ptr				= (void*)&timed_writer;
+		}
+
+		if (p_stats || p_rate_control)
+		{
+			picture.stats					= &aux_stats;		// asks libwebp to measure what it produced
+		}
+
+		// Compress.
+		b_encoded							= WebPEncode(&m_webp_config, &picture) != 0;
+
+		picture.stats						= NULL;
+
+		if (b_wrap_writer)
+		{
+			picture.writer					= timed_writer.writer;
+			picture.custom_ptr				= timed_writer.custom_ptr;
+		}
+
+		if (p_stats)
+		{
+			p_stats->f_output_ms			= timed_writer.f_elapsed_ms;
+			p_stats->f_encode_ms			= GetTimeMs() - f_start_ms - timed_writer.f_elapsed_ms;
+		}
+
+		WEBP_METRICS_RECORD(WEBP_METRIC_OP_ENCODE, n_metrics_start, (uint64_t)picture.width * picture.height, WebpPicturePool::GetPictureBytes(picture.width, picture.height, picture.a != NULL, picture.use_argb != 0),
+							b_wrap_writer ? timed_writer.n_bytes : 0, b_encoded ? 0 : (int)picture.error_code);
+
+		if (!b_encoded)
+		{
+			TRACE(_T("Error! Cannot encode picture as WebP Error code: %d (%s)"), picture.error_code, kErrorMessages[picture.error_code]);
+			return false;
+		}
+
+		if (p_stats)
+		{
+			CopyAuxStats(aux_stats, *p_stats);
+
+			p_stats->n_estimated_plane_bytes	= EstimatePlaneBytes(picture, p_stats->b_lossless, p_stats->n_coded_size);
+
+#ifdef _PRINT_IMG_CONVERSION_TIME
+			TRACE(_T("preprocess %.2f ms, encode %.2f ms, output %.2f ms"), p_stats->f_preprocess_ms, p_stats->f_encode_ms, p_stats->f_output_ms);
+#endif
+		}
+
+		if (p_rate_control)
+		{
+			*p_rate_control					= MakeRateControlResult(m_webp_config, aux_stats);
+		}
+
+		return true;
+}
+
+/*
+* Picture writer appending to a caller owned WebpOutputBuffer, the caller's grow callback is asked for more room when the bitstream doesn't fit
+*/
+static int OutputBufferWrite(const uint8_t* data, size_t data_size, const WebPPicture* const picture)
+{
+	WebpOutputBuffer* const				out = (WebpOutputBuffer*)picture->custom_ptr;
+
+	const size_t						n_required = out->n_size + data_size;
+
+	if (n_required > out->n_capacity)
+	{
+		size_t							n_new_capacity = 0;
+
+		uint8_t*						p_new_data = out->ptr_grow ? out->ptr_grow(out->p_user_data, out->p_data, out->n_size, n_required, &n_new_capacity) : NULL;
+
+		if (!p_new_data || n_new_capacity < n_required)
+		{
+			return 0;		// surfaces as VP8_ENC_ERROR_BAD_WRITE
+		}
+
+		out->p_data						= p_new_data;
+		out->n_capacity					= n_new_capacity;
+	}
+
+	if (data_size)
+	{
+		memcpy(out->p_data + out->n_size, data, data_size);
+	}
+
+	out->n_size							= n_required;
+
+	return 1;
+}
+
+/*
+* Picture writer forwarding every chunk to a WebpOutputSink
+*/
+static int OutputSinkWrite(const uint8_t* data, size_t data_size, const WebPPicture* const picture)
+{
+	WebpOutputSink* const				sink = (WebpOutputSink*)picture->custom_ptr;
+
+	return (data_size == 0 || sink->Write(data, data_size)) ? 1 : 0;
+}
+
+#endif
+
+bool WebpEncoder::EncodeImage(
+																_In_					uint8_t*													in_image, 
+																_In_					unsigned int														width, 
+																_In_					unsigned int														height, 
+																_In_					unsigned int														n_bytes_per_pixel, 	
+																_Inout_					std::vector<char>											&imgData, 
+																_Inout_					size_t														&output_size 
+							  )
+{
+		return EncodeImageWithStride(in_image, width, height, n_bytes_per_pixel, 0, imgData, output_size);
+}
+
+/*
+* Same as above for rows which are padded or part of a bigger surface, n_stride is the distance between two rows in bytes
+*/
+bool WebpEncoder::EncodeImageWithStride(
+																_In_					const uint8_t*												in_image, 
+																_In_					unsigned int														width, 
+																_In_					unsigned int														height, 
+																_In_					unsigned int														n_bytes_per_pixel, 	
+																_In_					unsigned int														n_stride, 	
+																_Inout_					std::vector<char>											&imgData, 
+																_Inout_					size_t														&output_size 
+							  )
+{
+		int									return_value = false;
+
+#ifdef _USE_WEBP_
+
+		WebPMemoryWriter					memory_writer;
+
+		WebPMemoryWriterInit(&memory_writer);
+
+		if (EncodeToWriter(in_image, width, height, n_bytes_per_pixel, n_stride ? n_stride : GetDefaultStride(n_pixel_format, width, n_bytes_per_pixel), WebPMemoryWrite, (void*)&memory_writer))
+		{
+			const double				f_copy_start_ms = b_collect_stats ? GetTimeMs() : 0;
+
+			output_size					= memory_writer.size;
+
+			imgData.assign(memory_writer.mem, memory_writer.mem  + output_size);
+
+			if (b_collect_stats)
+			{
+				const double			f_copy_ms = GetTimeMs() - f_copy_start_ms;
+
+				m_last_stats.f_output_ms	+= f_copy_ms;
+				m_last_stats.f_total_ms		+= f_copy_ms;
+			}
+
+			return_value = true;
+		}
+
+		WebPMemoryWriterClear(&memory_writer);
+
+#endif
+
+		return return_value;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Zero copy output modes. EncodeImageInto writes the bitstream into the caller's buffer, EncodeImageToView into the encoder's own arena which keeps
+// its memory from one call to the next, so neither allocates nor copies the bitstream once the buffers have reached their working size.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WebpEncoder::EncodeImageInto(
+																_In_					const uint8_t*												in_image, 
+																_In_					unsigned int														width, 
+																_In_					unsigned int														height, 
+																_In_					unsigned int														n_bytes_per_pixel, 	
+																_Inout_					WebpOutputBuffer											&out_buffer, 
+																_In_					unsigned int														n_stride
+							  )
+{
+		int									return_value = false;
+
+		out_buffer.n_size					= 0;
+
+#ifdef _USE_WEBP_
+
+		return_value = EncodeToWriter(in_image, width, height, n_bytes_per_pixel, n_stride ? n_stride : GetDefaultStride(n_pixel_format, width, n_bytes_per_pixel), OutputBufferWrite, (void*)&out_buffer);
+
+#endif
+
+		return return_value;
+}
+
+bool WebpEncoder::EncodeImageToView(
+																_In_					const uint8_t*												in_image, 
+																_In_					unsigned int														width, 
+																_In_					unsigned int														height, 
+																_In_					unsigned int														n_bytes_per_pixel, 	
+																_Inout_					const uint8_t*												&out_data, 
+																_Inout_					size_t														&output_size, 
+																_In_					unsigned int														n_stride
+							  )
+{
+		int									return_value = false;
+
+		out_data							= NULL;
+		output_size							= 0;
+
+#ifdef _USE_WEBP_
+
+		m_output_arena.size					= 0;		// keeps the memory of the previous encode
+
+		if (EncodeToWriter(in_image, width, height, n_bytes_per_pixel, n_stride ? n_stride : GetDefaultStride(n_pixel_format, width, n_bytes_per_pixel), WebPMemoryWrite, (void*)&m_output_arena))
+		{
+			out_data						= m_output_arena.mem;
+			output_size						= m_output_arena.size;
+
+			return_value = true;
+		}
+
+#endif
+
+		return return_value;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Hands the bitstream to a sink chunk by chunk as libwebp writes it out at the end of the encode, nothing is buffered on our side
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WebpEncoder::EncodeImageToSink(
+																_In_					const uint8_t*												in_image, 
+																_In_					unsigned int														width, 
+																_In_					unsigned int														height, 
+																_In_					unsigned int														n_bytes_per_pixel, 	
+																_Inout_					WebpOutputSink												&sink, 
+																_In_					unsigned int														n_stride
+							  )
+{
+		int									return_value = false;
+
+#ifdef _USE_WEBP_
+
+		return_value = EncodeToWriter(in_image, width, height, n_bytes_per_pixel, n_stride ? n_stride : GetDefaultStride(n_pixel_format, width, n_bytes_per_pixel), OutputSinkWrite, (void*)&sink);
+
+#endif
+
+		if (return_value)
+		{
+			return_value = sink.Finish();
+		}
+		else
+		{
+			sink.Abort();
+		}
+
+		return return_value;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// YUV input, for frames coming out of a video pipeline. They skip the RGB to YUV conversion and, for I420, any copy of the pixels.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WebpEncoder::EncodeYUV(
+																_In_					const WebpYUVPlanes											&planes, 
+																_Inout_					std::vector<char>											&imgData, 
+																_Inout_					size_t														&output_size 
+							  )
+{
+		int									return_value = false;
+
+#ifdef _USE_WEBP_
+
+		WebPMemoryWriter					memory_writer;
+
+		WebPMemoryWriterInit(&memory_writer);
+
+		if (EncodeYUVToWriter(planes, WebPMemoryWrite, (void*)&memory_writer))
+		{
+			const double				f_copy_start_ms = b_collect_stats ? GetTimeMs() : 0;
+
+			output_size					= memory_writer.size;
+
+			imgData.assign(memory_writer.mem, memory_writer.mem  + output_size);
+
+			if (b_collect_stats)
+			{
+				const double			f_copy_ms = GetTimeMs() - f_copy_start_ms;
+
+				m_last_stats.f_output_ms	+= f_copy_ms;
+				m_last_stats.f_total_ms		+= f_copy_ms;
+			}
+
+			return_value = true;
+		}
+
+		WebPMemoryWriterClear(&memory_writer);
+
+#endif
+
+		return return_value;
+}
+
+bool WebpEncoder::EncodeYUVInto(
+																_In_					const WebpYUVPlanes											&planes, 
+																_Inout_					WebpOutputBuffer											&out_buffer 
+							  )
+{
+		int									return_value = false;
+
+		out_buffer.n_size					= 0;
+
+#ifdef _USE_WEBP_
+
+		return_value = EncodeYUVToWriter(planes, OutputBufferWrite, (void*)&out_buffer);
+
+#endif
+
+		return return_value;
+}
+
+bool WebpEncoder::EncodeYUVToSink(
+																_In_					const WebpYUVPlanes											&planes, 
+																_Inout_					WebpOutputSink												&sink 
+							  )
+{
+		int									return_value = false;
+
+#ifdef _USE_WEBP_
+
+		return_value = EncodeYUVToWriter(planes, OutputSinkWrite, (void*)&sink);
+
+#endif
+
+		if (return_value)
+		{
+			return_value = sink.Finish();
+		}
+		else
+		{
+			sink.Abort();
+		}
+
+		return return_value;
+}
+
+#ifdef _USE_WEBP_
+
+/*
+* One candidate encode of the quality search
+*/
+struct WebpQualityProbe
+{
+	float								f_quality;
+
+	bool								b_lossless;
+
+	bool								b_done;
+
+	bool								b_passed;
+
+	float								f_metric;		// dB, as returned by WebPPictureDistortion
+
+	std::vector<char>					data;
+
+	WebpQualityProbe()
+	{
+		f_quality = 0;
+
+		b_lossless = false;
+
+		b_done = false;
+
+		b_passed = false;
+
+		f_metric = 0;
+	}
+};
+
+static float QualityFloorToDb( const WebpQualityFloor &quality_floor )
+{
+	if (quality_floor.n_metric == WEBP_QUALITY_METRIC_SSIM)
+	{
+		const double f_error = 1.0 - quality_floor.f_min_value;
+
+		return f_error > 1e-10 ? (float)(-10.0 * log10(f_error)) : 99.f;
+	}
+
+	return quality_floor.f_min_value;
+}
+
+/*
+* Encodes a copy of the imported picture (WebPEncode may rewrite transparent areas of its input), decodes the result straight into an ARGB
+* picture and measures it against the reference
+*/
+static void RunQualityProbe( const WebPConfig &base_config, const WebPPicture &source, const WebPPicture &reference, int metric_type, float f_floor_db, WebpQualityProbe &probe )
+{
+	WebPConfig							config = base_config;
+	WebPPicture							picture;
+	WebPPicture							decoded;
+	WebPMemoryWriter					writer;
+	WebPDecoderConfig					dec_config;
+	float								distortion[5];
+
+	probe.b_done						= false;
+	probe.b_passed						= false;
+
+	config.quality						= probe.f_quality;
+	config.lossless						= probe.b_lossless;
+	config.target_size					= 0;		// the search replaces rate control
+	config.target_PSNR					= 0;
+
+	WebPMemoryWriterInit(&writer);
+
+	if (!WebPPictureInit(&picture) || !WebPPictureInit(&decoded) || !WebPInitDecoderConfig(&dec_config))
+	{
+		return;
+	}
+
+	if (!WebPPictureCopy(probe.b_lossless ? &reference : &source, &picture))
+	{
+		goto Error;
+	}
+
+	picture.writer						= WebPMemoryWrite;
+	picture.custom_ptr					= (void*)&writer;
+
+	if (!WebPEncode(&config, &picture))
+	{
+		goto Error;
+	}
+
+	decoded.use_argb					= true;
+	decoded.width						= reference.width;
+	decoded.height						= reference.height;
+
+	if (!WebPPictureAlloc(&decoded))
+	{
+		goto Error;
+	}
+
+	dec_config.output.colorspace		= MODE_BGRA;		// little endian ARGB words, like webpdec.c
+	dec_config.output.is_external_memory = 1;
+	dec_config.output.u.RGBA.rgba		= (uint8_t*)decoded.argb;
+	dec_config.output.u.RGBA.stride		= decoded.argb_stride * sizeof(uint32_t);
+	dec_config.output.u.RGBA.size		= dec_config.output.u.RGBA.stride * decoded.height;
+
+	if (WebPDecode(writer.mem, writer.size, &dec_config) != VP8_STATUS_OK)
+	{
+		goto Error;
+	}
+
+	if (!WebPPictureDistortion(&decoded, &reference, metric_type, distortion))
+	{
+		goto Error;
+	}
+
+	probe.f_metric						= distortion[4];
+	probe.b_passed						= distortion[4] >= f_floor_db;
+	probe.b_done						= true;
+
+	probe.data.assign(writer.mem, writer.mem + writer.size);
+
+Error:
+	WebPFreeDecBuffer(&dec_config.output);
+	WebPPictureFree(&decoded);
+	WebPPictureFree(&picture);
+	WebPMemoryWriterClear(&writer);
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Smallest bitstream whose PSNR/SSIM stays above a floor. The input is imported once, as ARGB for the measurements and as YUV for the lossy
+// probes, then each round encodes n_parallel_probes qualities spread over the open range on the pool and narrows the range to the gap between
+// the best failing and the lowest passing quality. With 8 probes per round the search over 0 - 100 takes 3 rounds.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WebpEncoder::EncodeToQualityFloor(
+																_In_					const uint8_t*												in_image, 
+																_In_					unsigned int														width, 
+																_In_					unsigned int														height, 
+																_In_					unsigned int														n_bytes_per_pixel, 	
+																_In_					const WebpQualityFloor										&quality_floor, 
+																_Inout_					std::vector<char>											&out_img, 
+																_Inout_					size_t														&output_size, 
+																_Inout_					WebpQualitySearchResult*									p_result, 
+																_In_					unsigned int														n_stride
+							  )
+{
+		bool								return_value = false;
+
+		WebpQualitySearchResult				result;
+
+#ifdef _USE_WEBP_
+
+		WebPPicture							reference;
+		WebPPicture							source;
+
+		std::vector<WebpQualityProbe>		probes;
+
+		WebpQualityProbe					best;
+		WebpQualityProbe					fallback;		// highest quality tried, returned when nothing reaches the floor
+
+		WebpThreadPool						*pool = NULL;
+
+		const int							stride = n_stride ? (int)n_stride : (int)GetDefaultStride(n_pixel_format, width, n_bytes_per_pixel);
+		const int							metric_type = (quality_floor.n_metric == WEBP_QUALITY_METRIC_SSIM) ? 1 : 0;
+		const float							f_floor_db = QualityFloorToDb(quality_floor);
+		const float							f_tolerance = quality_floor.f_tolerance > 0.01f ? quality_floor.f_tolerance : 0.01f;
+
+		float								f_fail = quality_floor.f_min_quality - f_tolerance;		// highest quality known to miss the floor
+		float								f_pass = quality_floor.f_max_quality;					// lowest quality known to reach it
+		bool								b_any_pass = false;
+		unsigned int						n_parallel = 0;
+
+		fallback.f_quality					= -1;
+
+		if (!b_config_valid || !in_image || quality_floor.f_max_quality < quality_floor.f_min_quality)
+		{
+			TRACE(_T("Error! Encoder is not initialized or the search range is empty"));
+			return false;
+		}
+
+		if (!WebPPictureInit(&reference) || !WebPPictureInit(&source))
+		{
+			TRACE(_T("Error! Version mismatch!"));
+			return false;
+		}
+
+		reference.use_argb					= true;
+		reference.width						= width;
+		reference.height					= height;
+
+		source.use_argb						= false;
+		source.width						= width;
+		source.height						= height;
+
+		if (!ImportPicture(&reference, in_image, stride, n_bytes_per_pixel, true, false) || (!reference.use_argb && !WebPPictureYUVAToARGB(&reference)))
+		{
+			TRACE(_T("Error! Cannot import picture"));
+			goto Error;
+		}
+
+		if (IsPlanarYUV(n_pixel_format))
+		{
+			if (!ImportPicture(&source, in_image, stride, n_bytes_per_pixel, false, false))		// attaches the planes again, nothing is converted
+			{
+				goto Error;
+			}
+		}
+		else if (!WebPPictureView(&reference, 0, 0, width, height, &source) || !WebPPictureARGBToYUVA(&source, WEBP_YUV420))
+		{
+			TRACE(_T("Error! Cannot convert picture to YUV"));
+			goto Error;
+		}
+
+		pool								= GetThreadPool();
+		n_parallel							= quality_floor.n_parallel_probes ? quality_floor.n_parallel_probes : pool->GetThreadCount();
+
+		for (bool b_first_round = true; ; b_first_round = false)
+		{
+			probes.clear();
+
+			if (b_first_round)
+			{
+				// the top of the range is always tried, it tells whether the floor can be reached at all
+
+				for (unsigned int i = 0; i < n_parallel; ++i)
+				{
+					WebpQualityProbe probe;
+
+					probe.b_lossless		= false;
+					probe.f_quality			= quality_floor.f_min_quality + (quality_floor.f_max_quality - quality_floor.f_min_quality) * (i + 1) / n_parallel;
+
+					probes.push_back(probe);
+				}
+
+				if (quality_floor.b_try_lossless)
+				{
+					WebpQualityProbe probe;
+
+					probe.b_lossless		= true;
+					probe.f_quality			= m_webp_config.quality;		// effort of the lossless encode
+
+					probes.push_back(probe);
+				}
+			}
+			else
+			{
+				for (unsigned int i = 0; i < n_parallel; ++i)
+				{
+					WebpQualityProbe probe;
+
+					probe.b_lossless		= false;
+					probe.f_quality			= f_fail + (f_pass - f_fail) * (i + 1) / (n_parallel + 1);
+
+					if (probe.f_quality < quality_floor.f_min_quality)
+					{
+						probe.f_quality		= quality_floor.f_min_quality;
+					}
+
+					probes.push_back(probe);
+				}
+			}
+
+			const WebPConfig				&config = m_webp_config;
+
+			pool->ParallelFor(probes.size(), [&](size_t n_probe, unsigned int)
+			{
+				RunQualityProbe(config, source, reference, metric_type, f_floor_db, probes[n_probe]);
+			});
+
+			++result.n_rounds;
+
+			result.n_probes					+= (unsigned int)probes.size();
+
+			for (size_t i = 0; i < probes.size(); ++i)
+			{
+				WebpQualityProbe			&probe = probes[i];
+
+				if (!probe.b_done)
+				{
+					continue;
+				}
+
+				if (!probe.b_lossless && probe.f_quality > fallback.f_quality)
+				{
+					fallback				= probe;
+				}
+
+				if (probe.b_passed)
+				{
+					if (!probe.b_lossless && (!b_any_pass || probe.f_quality < f_pass))
+					{
+						f_pass				= probe.f_quality;
+						b_any_pass			= true;
+					}
+
+					if (!best.b_done || probe.data.size() < best.data.size())
+					{
+						best				= std::move(probe);		// only its quality is looked at after this
+					}
+				}
+			}
+
+			for (size_t i = 0; i < probes.size(); ++i)
+			{
+				if (probes[i].b_done && !probes[i].b_passed && !probes[i].b_lossless && probes[i].f_quality < f_pass && probes[i].f_quality > f_fail)
+				{
+					f_fail					= probes[i].f_quality;
+				}
+			}
+
+			if (!b_any_pass || f_pass - f_fail <= f_tolerance || f_pass <= quality_floor.f_min_quality)
+			{
+				break;		// floor out of reach for lossy, or the range is narrow enough
+			}
+		}
+
+		if (!best.b_done && !fallback.b_done)
+		{
+			TRACE(_T("Error! Every probe of the quality search failed"));
+			goto Error;
+		}
+
+		{
+			WebpQualityProbe				&chosen = best.b_done ? best : fallback;
+
+			out_img.swap(chosen.data);
+
+			output_size						= out_img.size();
+
+			result.f_quality				= chosen.f_quality;
+			result.b_lossless				= chosen.b_lossless;
+			result.n_size					= output_size;
+			result.b_floor_met				= best.b_done;
+			result.f_metric					= (metric_type == 1) ? (float)(1.0 - pow(10.0, -chosen.f_metric / 10.0)) : chosen.f_metric;
+		}
+
+		return_value						= result.b_floor_met;
+
+Error:
+		WebPPictureFree(&source);
+		WebPPictureFree(&reference);
+
+#endif
+
+		if (p_result)
+		{
+			*p_result						= result;
+		}
+
+		return return_value;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Encodes a batch of images over the encoder's pool, every item reports its own status so one bad image doesn't fail the others
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WebpEncoder::EncodeBatch(
+																_In_					const WebpBatchInput*										inputs, 
+																_In_					size_t														n_count, 
+																_Inout_					WebpBatchOutput*											outputs
+							  )
+{
+		if (n_count == 0)
+		{
+			return true;
+		}
+
+		if (!inputs || !outputs || !b_config_valid)
+		{
+			return false;
+		}
+
+		std::atomic<size_t>					n_failed(0);
+
+		GetPicturePool();		// created up front, the workers only share it
+
+		GetThreadPool()->ParallelFor(n_count, [&](size_t n_index, unsigned int n_worker_id)
+		{
+			if (!EncodeBatchItem(inputs[n_index], outputs[n_index], *m_workers[n_worker_id]))
+			{
+				++n_failed;
+			}
+		});
+
+		return n_failed == 0;
+}
+
+bool WebpEncoder::EncodeBatchItem( _In_ const WebpBatchInput &input, _Inout_ WebpBatchOutput &output, _Inout_ WebpEncoderWorker &worker )
+{
+		output.b_success					= false;
+		output.output_size					= 0;
+		output.n_error_code					= 0;
+		output.f_psnr						= 0;
+
+#ifdef _USE_WEBP_
+
+		WebPMemoryWriter					&memory_writer	= worker.memory_writer;
+
+		if (!input.p_image || (input.n_bytes_per_pixel == 0 && input.n_stride == 0))
+		{
+			output.n_error_code				= VP8_ENC_ERROR_NULL_PARAMETER;
+			return false;
+		}
+
+		const int							stride = input.n_stride ? (int)input.n_stride : (int)GetDefaultStride(n_pixel_format, input.n_width, input.n_bytes_per_pixel);
+
+		WebPPicture							local_picture;
+
+		WebPPicture							*pooled_picture	= AcquirePooledPicture(input.n_width, input.n_height);
+
+		WebPPicture							&picture		= pooled_picture ? *pooled_picture : local_picture;
+
+		memory_writer.size					= 0;		// keeps the buffer of the previous item
+
+		if (!pooled_picture)
+		{
+			WebPPictureInit(&picture);
+
+			picture.use_argb				= false;
+			picture.width					= input.n_width;
+			picture.height					= input.n_height;
+		}
+
+		picture.error_code					= VP8_ENC_OK;		// a pooled picture may carry the error of its previous item
+
+		WebpEncodeStats						*p_stats = b_collect_stats ? &output.stats : NULL;
+
+		WebpRateControlResult				rate_control;		// per item, the member is only for the single image encodes
+
+		const double						f_start_ms = p_stats ? GetTimeMs() : 0;
+
+		if (p_stats)
+		{
+			*p_stats						= WebpEncodeStats();
+		}
+
+		picture.writer						= WebPMemoryWrite;
+		picture.custom_ptr					= (void*)&memory_writer;
+
+		WEBP_METRICS_START(n_import_start);
+
+		const bool							b_imported = ImportPicture(&picture, input.p_image, stride, input.n_bytes_per_pixel ? input.n_bytes_per_pixel : GetInputBytesPerPixel(n_pixel_format), false, pooled_picture != NULL, &worker.plane_scratch);		// already running on a pool worker
+
+		WEBP_METRICS_RECORD(WEBP_METRIC_OP_IMPORT, n_import_start, (uint64_t)input.n_width * input.n_height, (uint64_t)stride * input.n_height, 0, b_imported ? 0 : (int)picture.error_code);
+
+		if (!b_imported)
+		{
+			output.n_error_code				= picture.error_code;
+		}
+		else
+		{
+			if (p_stats)
+			{
+				p_stats->f_import_ms		= GetTimeMs() - f_start_ms;
+			}
+
+			if (!EncodePicture(picture, p_stats, b_rate_control ? &rate_control : NULL))
+			{
+				output.n_error_code			= picture.error_code;
+			}
+			else
+			{
+				const double				f_copy_start_ms = p_stats ? GetTimeMs() : 0;
+
+				output.output_size			= memory_writer.size;
+
+				output.out_img.assign(memory_writer.mem, memory_writer.mem + memory_writer.size);
+
+				output.b_success			= true;
+
+				if (p_stats)
+				{
+					p_stats->f_output_ms	+= GetTimeMs() - f_copy_start_ms;
+					p_stats->f_total_ms		= GetTimeMs() - f_start_ms;
+				}
+			}
+		}
+
+		if (output.b_success && b_rate_control)
+		{
+			output.f_psnr					= rate_control.f_psnr;
+		}
+
+		if (pooled_picture)
+		{
+			m_picture_pool->Release(pooled_picture);
+		}
+		else
+		{
+			WebPPictureFree(&picture);
+		}
+
+#endif
+
+		return output.b_success;
+}
+
+/*
+* Stage timings and bitstream statistics of the last single image encode
+*/
+bool WebpEncoder::GetLastEncodeStats( _Inout_ WebpEncodeStats &stats ) const
+{
+	if (!b_collect_stats || m_last_stats.n_coded_size == 0)
+	{
+		return false;
+	}
+
+	stats = m_last_stats;
+
+	return true;
+}
+
+/*
+* Size and PSNR reached by the last single image encode in rate control mode
+*/
+bool WebpEncoder::GetLastRateControlResult( _Inout_ WebpRateControlResult &result ) const
+{
+	if (!b_rate_control || m_last_rate_control.n_coded_size == 0)
+	{
+		return false;
+	}
+
+	result = m_last_rate_control;
+
+	return true;
+}
+
+/*
+* Snapshot of the picture pool counters
+*/
+bool WebpEncoder::GetPicturePoolStats( _Inout_ WebpPicturePoolStats &stats ) const
+{
+#ifdef _USE_WEBP_
+
+	if (m_picture_pool)
+	{
+		stats = m_picture_pool->GetStats();
+
+		return true;
+	}
+
+#endif
+
+	stats = WebpPicturePoolStats();
+
+	return false;
+}
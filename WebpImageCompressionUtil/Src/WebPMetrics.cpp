@@ -0,0 +1,301 @@
+/********************************************************************************************************************************************************************************************
+* FileName   : WebPMetrics.cpp
+* Description: Lock free counters and latency histograms of the encode/decode hot paths with a Prometheus text dump
+* Date		 : 17/10/2026
+* Author     : Ramesh Kumar K
+*
+********************************************************************************************************************************************************************************************/
+
+# include "WebPMetrics.h"
+# include <atomic>
+# include <chrono>
+# include <stdarg.h>
+# include <stdio.h>
+# include <string.h>
+# include <string>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Registry layout. Latency bucket i counts operations which took [2^i, 2^(i+1)) microseconds, the last one everything slower. The size buckets
+// split the histograms by picture size so a slow thumbnail doesn't hide behind fast 4K frames.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define WEBP_METRIC_LATENCY_BUCKETS										24
+#define WEBP_METRIC_SIZE_BUCKETS										5
+
+static const uint64_t kSizeBucketLimits[WEBP_METRIC_SIZE_BUCKETS - 1]	= { 64 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024 };	// pixels
+
+static const char* const kSizeBucketNames[WEBP_METRIC_SIZE_BUCKETS]	= { "lt_64k", "lt_256k", "lt_1m", "lt_4m", "ge_4m" };
+
+static const char* const kOperationNames[WEBP_METRIC_OP_COUNT]			= { "import", "encode", "decode", "read_png", "read_jpeg", "read_tiff", "read_webp", "read_pnm" };
+
+static const char* const kEncodeErrorNames[]							= { "OK", "OUT_OF_MEMORY", "BITSTREAM_OUT_OF_MEMORY", "NULL_PARAMETER", "INVALID_CONFIGURATION", "BAD_DIMENSION",
+																			"PARTITION0_OVERFLOW", "PARTITION_OVERFLOW", "BAD_WRITE", "FILE_TOO_BIG", "USER_ABORT" };
+
+static const char* const kDecodeStatusNames[]							= { "OK", "OUT_OF_MEMORY", "INVALID_PARAM", "BITSTREAM_ERROR", "UNSUPPORTED_FEATURE", "SUSPENDED", "USER_ABORT",
+																			"NOT_ENOUGH_DATA" };
+
+struct alignas(64) WebpOperationMetrics		// one cache line block per operation, the workers of a batch mostly touch the same one
+{
+	std::atomic<uint64_t>												n_calls;
+
+	std::atomic<uint64_t>												n_failures;
+
+	std::atomic<uint64_t>												n_pixels;
+
+	std::atomic<uint64_t>												n_bytes_in;
+
+	std::atomic<uint64_t>												n_bytes_out;
+
+	std::atomic<uint64_t>												n_errors[WEBP_METRIC_MAX_ERROR_CODES];
+
+	std::atomic<uint64_t>												n_latency[WEBP_METRIC_SIZE_BUCKETS][WEBP_METRIC_LATENCY_BUCKETS];
+
+	std::atomic<uint64_t>												n_latency_sum_ns[WEBP_METRIC_SIZE_BUCKETS];
+};
+
+static WebpOperationMetrics												g_operations[WEBP_METRIC_OP_COUNT];		// static storage, starts zeroed
+
+static std::atomic<int>													g_enabled(0);
+
+void WebpMetricsSetEnabled( int b_enabled )
+{
+	g_enabled.store(b_enabled ? 1 : 0, std::memory_order_relaxed);
+}
+
+int WebpMetricsIsEnabled( void )
+{
+	return g_enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t WebpMetricsNow( void )
+{
+	const uint64_t n_now = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	return n_now ? n_now : 1;		// 0 means "not measured" to the recording macros
+}
+
+static int GetSizeBucket( uint64_t n_pixels )
+{
+	int n_bucket = 0;
+
+	while (n_bucket < WEBP_METRIC_SIZE_BUCKETS - 1 && n_pixels >= kSizeBucketLimits[n_bucket])
+	{
+		++n_bucket;
+	}
+
+	return n_bucket;
+}
+
+static int GetLatencyBucket( uint64_t n_elapsed_ns )
+{
+	uint64_t	n_us		= n_elapsed_ns / 1000;
+	int			n_bucket	= 0;
+
+	while (n_us > 1 && n_bucket < WEBP_METRIC_LATENCY_BUCKETS - 1)
+	{
+		n_us >>= 1;
+		++n_bucket;
+	}
+
+	return n_bucket;
+}
+
+void WebpMetricsRecord( WEBP_METRIC_OP n_op, uint64_t n_start_ns, uint64_t n_pixels, uint64_t n_bytes_in, uint64_t n_bytes_out, int n_error_code )
+{
+	if ((unsigned)n_op >= WEBP_METRIC_OP_COUNT)
+	{
+		return;
+	}
+
+	const uint64_t				n_now		= WebpMetricsNow();
+	const uint64_t				n_elapsed	= n_now > n_start_ns ? n_now - n_start_ns : 0;
+	const int					n_size		= GetSizeBucket(n_pixels);
+
+	WebpOperationMetrics		&metrics	= g_operations[n_op];
+
+	metrics.n_calls.fetch_add(1, std::memory_order_relaxed);
+	metrics.n_pixels.fetch_add(n_pixels, std::memory_order_relaxed);
+	metrics.n_bytes_in.fetch_add(n_bytes_in, std::memory_order_relaxed);
+	metrics.n_bytes_out.fetch_add(n_bytes_out, std::memory_order_relaxed);
+
+	if (n_error_code != 0)
+	{
+		const int n_slot = (n_error_code > 0 && n_error_code < WEBP_METRIC_MAX_ERROR_CODES) ? n_error_code : WEBP_METRIC_MAX_ERROR_CODES - 1;
+
+		metrics.n_failures.fetch_add(1, std::memory_order_relaxed);
+		metrics.n_errors[n_slot].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	metrics.n_latency[n_size][GetLatencyBucket(n_elapsed)].fetch_add(1, std::memory_order_relaxed);
+	metrics.n_latency_sum_ns[n_size].fetch_add(n_elapsed, std::memory_order_relaxed);
+}
+
+void WebpMetricsReset( void )
+{
+	for (int op = 0; op < WEBP_METRIC_OP_COUNT; ++op)
+	{
+		WebpOperationMetrics &metrics = g_operations[op];
+
+		metrics.n_calls		= 0;
+		metrics.n_failures	= 0;
+		metrics.n_pixels	= 0;
+		metrics.n_bytes_in	= 0;
+		metrics.n_bytes_out	= 0;
+
+		for (int i = 0; i < WEBP_METRIC_MAX_ERROR_CODES; ++i)
+		{
+			metrics.n_errors[i] = 0;
+		}
+
+		for (int s = 0; s < WEBP_METRIC_SIZE_BUCKETS; ++s)
+		{
+			for (int i = 0; i < WEBP_METRIC_LATENCY_BUCKETS; ++i)
+			{
+				metrics.n_latency[s][i] = 0;
+			}
+
+			metrics.n_latency_sum_ns[s] = 0;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Prometheus text exposition. Operations which never ran are left out, the histograms are cumulative as the format wants them.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void AppendFormat( std::string &text, const char* format, ... )
+{
+	char		line[256];
+
+	va_list		args;
+
+	va_start(args, format);
+
+	const int	n_length = vsnprintf(line, sizeof(line), format, args);
+
+	va_end(args);
+
+	if (n_length > 0)
+	{
+		text.append(line, (size_t)n_length < sizeof(line) ? (size_t)n_length : sizeof(line) - 1);
+	}
+}
+
+static const char* GetErrorName( int n_op, int n_code, char* scratch, size_t n_scratch )
+{
+	if (n_op == WEBP_METRIC_OP_ENCODE && n_code < (int)(sizeof(kEncodeErrorNames) / sizeof(kEncodeErrorNames[0])))
+	{
+		return kEncodeErrorNames[n_code];
+	}
+
+	if (n_op == WEBP_METRIC_OP_DECODE && n_code < (int)(sizeof(kDecodeStatusNames) / sizeof(kDecodeStatusNames[0])))
+	{
+		return kDecodeStatusNames[n_code];
+	}
+
+	snprintf(scratch, n_scratch, "%d", n_code);
+
+	return scratch;
+}
+
+static void AppendCounter( std::string &text, const char* name, const char* help, std::atomic<uint64_t> WebpOperationMetrics::*counter )
+{
+	AppendFormat(text, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+
+	for (int op = 0; op < WEBP_METRIC_OP_COUNT; ++op)
+	{
+		const WebpOperationMetrics	&metrics = g_operations[op];
+
+		if (metrics.n_calls.load(std::memory_order_relaxed) == 0)
+		{
+			continue;
+		}
+
+		AppendFormat(text, "%s{op=\"%s\"} %llu\n", name, kOperationNames[op], (unsigned long long)(metrics.*counter).load(std::memory_order_relaxed));
+	}
+}
+
+size_t WebpMetricsDump( char* buffer, size_t n_capacity )
+{
+	std::string		text;
+
+	char			scratch[16];
+
+	AppendCounter(text, "webp_operations_total", "Operations completed, failed ones included.", &WebpOperationMetrics::n_calls);
+	AppendCounter(text, "webp_failures_total", "Operations which failed.", &WebpOperationMetrics::n_failures);
+	AppendCounter(text, "webp_pixels_total", "Pixels processed.", &WebpOperationMetrics::n_pixels);
+	AppendCounter(text, "webp_bytes_in_total", "Bytes read by the operations.", &WebpOperationMetrics::n_bytes_in);
+	AppendCounter(text, "webp_bytes_out_total", "Bytes produced by the operations.", &WebpOperationMetrics::n_bytes_out);
+
+	AppendFormat(text, "# HELP webp_errors_total Failures by VP8_ENC_ERROR_* (encode), VP8StatusCode (decode) or reader code.\n# TYPE webp_errors_total counter\n");
+
+	for (int op = 0; op < WEBP_METRIC_OP_COUNT; ++op)
+	{
+		for (int code = 1; code < WEBP_METRIC_MAX_ERROR_CODES; ++code)
+		{
+			const uint64_t n_count = g_operations[op].n_errors[code].load(std::memory_order_relaxed);
+
+			if (n_count)
+			{
+				AppendFormat(text, "webp_errors_total{op=\"%s\",code=\"%s\"} %llu\n", kOperationNames[op], GetErrorName(op, code, scratch, sizeof(scratch)), (unsigned long long)n_count);
+			}
+		}
+	}
+
+	AppendFormat(text, "# HELP webp_latency_seconds Wall clock time of an operation by picture size.\n# TYPE webp_latency_seconds histogram\n");
+
+	for (int op = 0; op < WEBP_METRIC_OP_COUNT; ++op)
+	{
+		const WebpOperationMetrics &metrics = g_operations[op];
+
+		if (metrics.n_calls.load(std::memory_order_relaxed) == 0)
+		{
+			continue;
+		}
+
+		for (int s = 0; s < WEBP_METRIC_SIZE_BUCKETS; ++s)
+		{
+			uint64_t n_cumulative = 0;
+
+			for (int i = 0; i < WEBP_METRIC_LATENCY_BUCKETS; ++i)
+			{
+				n_cumulative += metrics.n_latency[s][i].load(std::memory_order_relaxed);
+			}
+
+			if (n_cumulative == 0)
+			{
+				continue;
+			}
+
+			const uint64_t n_total = n_cumulative;
+
+			n_cumulative = 0;
+
+			for (int i = 0; i < WEBP_METRIC_LATENCY_BUCKETS - 1; ++i)
+			{
+				n_cumulative += metrics.n_latency[s][i].load(std::memory_order_relaxed);
+
+				AppendFormat(text, "webp_latency_seconds_bucket{op=\"%s\",size=\"%s\",le=\"%g\"} %llu\n", kOperationNames[op], kSizeBucketNames[s], (double)(2ull << i) * 1e-6, (unsigned long long)n_cumulative);
+			}
+
+			AppendFormat(text, "webp_latency_seconds_bucket{op=\"%s\",size=\"%s\",le=\"+Inf\"} %llu\n", kOperationNames[op], kSizeBucketNames[s], (unsigned long long)n_total);
+			AppendFormat(text, "webp_latency_seconds_sum{op=\"%s\",size=\"%s\"} %.9f\n", kOperationNames[op], kSizeBucketNames[s], (double)metrics.n_latency_sum_ns[s].load(std::memory_order_relaxed) * 1e-9);
+			AppendFormat(text, "webp_latency_seconds_count{op=\"%s\",size=\"%s\"} %llu\n", kOperationNames[op], kSizeBucketNames[s], (unsigned long long)n_total);
+		}
+	}
+
+	if (buffer && n_capacity)
+	{
+		const size_t n_copy = text.size() < n_capacity ? text.size() : n_capacity - 1;
+
+		memcpy(buffer, text.data(), n_copy);
+
+		buffer[n_copy] = '\0';
+	}
+
+	return text.size();
+}
@@ -0,0 +1,265 @@
+/********************************************************************************************************************************************************************************************
+* FileName   : WebPOutputSink.cpp
+* Description: Built-in sinks for streaming encode output
+* Date		 : 17/10/2026
+* Author     : Ramesh Kumar K
+*
+********************************************************************************************************************************************************************************************/
+
+# include "WebPOutputSink.h"
+# include <algorithm>
+# include <errno.h>
+# include <string.h>
+
+#if defined(_WIN32)
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File descriptor sink
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+WebpFileDescriptorSink::WebpFileDescriptorSink( _In_ int fd, _In_ bool b_close_fd )
+{
+	n_fd								= fd;
+
+	b_close								= b_close_fd;
+
+	n_bytes_written						= 0;
+}
+
+WebpFileDescriptorSink::~WebpFileDescriptorSink()
+{
+	Close();
+}
+
+bool WebpFileDescriptorSink::Write( _In_ const uint8_t* data, _In_ size_t data_size )
+{
+	if (n_fd < 0)
+	{
+		return false;
+	}
+
+	while (data_size > 0)
+	{
+#if defined(_WIN32)
+		const int n_chunk = data_size > 0x40000000 ? 0x40000000 : (int)data_size;
+		const int n_written = _write(n_fd, data, n_chunk);
+#else
+		const ssize_t n_written = write(n_fd, data, data_size);
+#endif
+
+		if (n_written < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return false;
+		}
+
+		data				+= n_written;
+		data_size			-= (size_t)n_written;
+		n_bytes_written		+= (size_t)n_written;
+	}
+
+	return true;
+}
+
+bool WebpFileDescriptorSink::Finish( )
+{
+	Close();
+
+	return true;
+}
+
+void WebpFileDescriptorSink::Abort( )
+{
+	Close();
+}
+
+size_t WebpFileDescriptorSink::GetBytesWritten( ) const
+{
+	return n_bytes_written;
+}
+
+void WebpFileDescriptorSink::Close( )
+{
+	if (b_close && n_fd >= 0)
+	{
+#if defined(_WIN32)
+		_close(n_fd);
+#else
+		close(n_fd);
+#endif
+	}
+
+	n_fd = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Memory sink
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+WebpMemorySink::WebpMemorySink()
+{
+	b_complete							= false;
+}
+
+bool WebpMemorySink::Write( _In_ const uint8_t* data, _In_ size_t data_size )
+{
+	m_data.insert(m_data.end(), data, data + data_size);
+
+	return true;
+}
+
+bool WebpMemorySink::Finish( )
+{
+	b_complete = true;
+
+	return true;
+}
+
+void WebpMemorySink::Abort( )
+{
+	m_data.clear();
+
+	b_complete = false;
+}
+
+const std::vector<char>& WebpMemorySink::GetData( ) const
+{
+	return m_data;
+}
+
+bool WebpMemorySink::IsComplete( ) const
+{
+	return b_complete;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Ring buffer sink
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+WebpRingBufferSink::WebpRingBufferSink( _In_ size_t n_capacity )
+	: m_buffer(n_capacity > 0 ? n_capacity : 1)
+{
+	n_head								= 0;
+
+	n_size								= 0;
+
+	b_finished							= false;
+
+	b_aborted							= false;
+}
+
+bool WebpRingBufferSink::Write( _In_ const uint8_t* data, _In_ size_t data_size )
+{
+	const size_t n_capacity = m_buffer.size();
+
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	while (data_size > 0)
+	{
+		m_not_full.wait(lock, [this, n_capacity] { return b_aborted || n_size < n_capacity; });
+
+		if (b_aborted)
+		{
+			return false;
+		}
+
+		const size_t n_tail		= (n_head + n_size) % n_capacity;
+		const size_t n_free		= n_capacity - n_size;
+		const size_t n_linear	= n_capacity - n_tail;		// room before wrapping around
+		const size_t n_chunk	= std::min(data_size, std::min(n_free, n_linear));
+
+		memcpy(&m_buffer[n_tail], data, n_chunk);
+
+		data		+= n_chunk;
+		data_size	-= n_chunk;
+		n_size		+= n_chunk;
+
+		m_not_empty.notify_one();
+	}
+
+	return true;
+}
+
+bool WebpRingBufferSink::Finish( )
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		b_finished = true;
+	}
+
+	m_not_empty.notify_all();
+
+	return !IsAborted();
+}
+
+void WebpRingBufferSink::Abort( )
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		b_aborted = true;
+	}
+
+	m_not_empty.notify_all();
+	m_not_full.notify_all();
+}
+
+void WebpRingBufferSink::CancelRead( )
+{
+	Abort();
+}
+
+bool WebpRingBufferSink::IsAborted( ) const
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	return b_aborted;
+}
+
+size_t WebpRingBufferSink::Read( _Inout_ uint8_t* buffer, _In_ size_t buffer_size )
+{
+	const size_t n_capacity = m_buffer.size();
+
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	m_not_empty.wait(lock, [this] { return b_aborted || b_finished || n_size > 0; });
+
+	if (b_aborted || buffer_size == 0)
+	{
+		return 0;
+	}
+
+	size_t n_read = 0;
+
+	while (n_read < buffer_size && n_size > 0)
+	{
+		const size_t n_linear	= n_capacity - n_head;
+		const size_t n_wanted	= buffer_size - n_read;
+		const size_t n_chunk	= std::min(n_wanted, std::min(n_size, n_linear));
+
+		memcpy(buffer + n_read, &m_buffer[n_head], n_chunk);
+
+		n_read	+= n_chunk;
+		n_head	= (n_head + n_chunk) % n_capacity;
+		n_size	-= n_chunk;
+	}
+
+	m_not_full.notify_one();
+
+	return n_read;
+}
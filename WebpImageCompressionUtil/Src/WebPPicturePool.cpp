@@ -0,0 +1,462 @@
+/********************************************************************************************************************************************************************************************
+* FileName   : WebPPicturePool.cpp
+* Description: Pool of pre-allocated WebPPictures reused across encodes
+* Date		 : 17/10/2026
+* Author     : Ramesh Kumar K
+*
+********************************************************************************************************************************************************************************************/
+
+# include "WebPPicturePool.h"
+# include <math.h>
+
+#ifdef _USE_WEBP_
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RGB -> YUV conversion, a port of libwebp's own import (picture_csp_enc.c) so a pooled picture encodes to the same bitstream as one imported
+// by WebPPictureImportRGB*. Y uses the BT.601 fixed point coefficients. The chroma of each 2x2 block is averaged in linear light through
+// libwebp's gamma tables and, where the block is partly transparent, weighted by alpha. Odd edges repeat the last column or row like libwebp.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define YUV_FIX															16
+#define YUV_HALF														(1 << (YUV_FIX - 1))
+
+#define GAMMA_FIX														12
+#define GAMMA_SCALE														((1 << GAMMA_FIX) - 1)
+#define GAMMA_TAB_FIX													7
+#define GAMMA_TAB_SCALE													(1 << GAMMA_TAB_FIX)
+#define GAMMA_TAB_ROUNDER												(GAMMA_TAB_SCALE >> 1)
+#define GAMMA_TAB_SIZE													(1 << (GAMMA_FIX - GAMMA_TAB_FIX))
+#define ALPHA_FIX														19
+
+struct WebpGammaTables
+{
+	uint16_t															to_linear[256];
+
+	int																	to_gamma[GAMMA_TAB_SIZE + 1];
+
+	uint32_t															inv_alpha[4 * 0xff + 1];	// (1 << ALPHA_FIX) / a
+
+	WebpGammaTables()
+	{
+		const double	kGamma	= 0.80;
+		const double	scale	= (double)(1 << GAMMA_TAB_FIX) / GAMMA_SCALE;
+		const double	norm	= 1. / 255.;
+
+		for (int v = 0; v <= 255; ++v)
+		{
+			to_linear[v] = (uint16_t)(pow(norm * v, kGamma) * GAMMA_SCALE + .5);
+		}
+
+		for (int v = 0; v <= GAMMA_TAB_SIZE; ++v)
+		{
+			to_gamma[v] = (int)(255. * pow(scale * v, 1. / kGamma) + .5);
+		}
+
+		inv_alpha[0] = 0;
+
+		for (int a = 1; a <= 4 * 0xff; ++a)
+		{
+			inv_alpha[a] = (1u << ALPHA_FIX) / a;
+		}
+	}
+};
+
+static const WebpGammaTables& GetGammaTables( )
+{
+	static const WebpGammaTables tables;		// thread safe initialisation since C++11
+
+	return tables;
+}
+
+static inline int RGBToY(int r, int g, int b)
+{
+	return (16839 * r + 33059 * g + 6420 * b + YUV_HALF + (16 << YUV_FIX)) >> YUV_FIX;
+}
+
+static inline int ClipUV(int uv)
+{
+	uv = (uv + (YUV_HALF << 2) + (128 << (YUV_FIX + 2))) >> (YUV_FIX + 2);
+
+	return ((uv & ~0xff) == 0) ? uv : (uv < 0) ? 0 : 255;
+}
+
+static inline int RGBToU(int r4, int g4, int b4)		// 4x scaled averages
+{
+	return ClipUV(-9719 * r4 - 19081 * g4 + 28800 * b4);
+}
+
+static inline int RGBToV(int r4, int g4, int b4)
+{
+	return ClipUV(28800 * r4 - 24116 * g4 - 4684 * b4);
+}
+
+/*
+* Sum of linear values back to gamma space, 4x scaled. shift 1 doubles a sum of two samples.
+*/
+static inline int LinearToGamma(const WebpGammaTables &tables, uint32_t n_sum, int shift)
+{
+	const int v			= (int)(n_sum << shift);
+	const int tab_pos	= v >> (GAMMA_TAB_FIX + 2);
+	const int x			= v & ((GAMMA_TAB_SCALE << 2) - 1);
+	const int y			= tables.to_gamma[tab_pos + 1] * x + tables.to_gamma[tab_pos] * ((GAMMA_TAB_SCALE << 2) - x);
+
+	return (y + GAMMA_TAB_ROUNDER) >> GAMMA_TAB_FIX;
+}
+
+/*
+* 4x scaled average of one channel over the block p00 p01 / p10 p11, c is the byte of the channel and a of the alpha (-1 without alpha)
+*/
+static inline int AverageChannel(const WebpGammaTables &tables, const uint8_t* p00, const uint8_t* p01, const uint8_t* p10, const uint8_t* p11, bool b_pair_x, int c, int a, uint32_t total_a)
+{
+	if (a < 0 || total_a == 4 * 0xff || total_a == 0)
+	{
+		if (!b_pair_x)
+		{
+			return LinearToGamma(tables, tables.to_linear[p00[c]] + tables.to_linear[p10[c]], 1);
+		}
+
+		return LinearToGamma(tables, tables.to_linear[p00[c]] + tables.to_linear[p01[c]] + tables.to_linear[p10[c]] + tables.to_linear[p11[c]], 0);
+	}
+
+	const uint32_t n_sum = p00[a] * tables.to_linear[p00[c]] + p01[a] * tables.to_linear[p01[c]] + p10[a] * tables.to_linear[p10[c]] + p11[a] * tables.to_linear[p11[c]];
+
+	return LinearToGamma(tables, (n_sum * tables.inv_alpha[total_a]) >> (ALPHA_FIX - 2), 0);
+}
+
+/*
+* Constructor
+*/
+WebpPicturePool::WebpPicturePool( _In_ size_t n_max_idle )
+{
+	n_max_idle_bytes					= n_max_idle;
+
+	n_clock								= 0;
+}
+
+/*
+* Destructor, pictures still handed out are freed as well so the owner must not use them after the pool is gone
+*/
+WebpPicturePool::~WebpPicturePool()
+{
+	Clear();
+
+	for (size_t i = 0; i < m_in_use.size(); ++i)
+	{
+		WebPPictureFree(m_in_use[i].picture);
+
+		delete m_in_use[i].picture;
+	}
+}
+
+size_t WebpPicturePool::GetPictureBytes( _In_ int width, _In_ int height, _In_ bool b_has_alpha, _In_ bool b_use_argb )
+{
+	if (b_use_argb)
+	{
+		return (size_t)width * height * sizeof(uint32_t);
+	}
+
+	const size_t uv_size = (size_t)((width + 1) >> 1) * ((height + 1) >> 1);
+
+	return (size_t)width * height * (b_has_alpha ? 2 : 1) + 2 * uv_size;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Returns a picture of the requested layout, its planes are allocated but their content is whatever the previous user left
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+WebPPicture* WebpPicturePool::Acquire( _In_ int width, _In_ int height, _In_ bool b_has_alpha, _In_ bool b_use_argb )
+{
+	if (width <= 0 || height <= 0)
+	{
+		return NULL;
+	}
+
+	Entry entry;
+
+	entry.picture		= NULL;
+	entry.n_bytes		= GetPictureBytes(width, height, b_has_alpha, b_use_argb);
+	entry.b_has_alpha	= b_has_alpha;
+	entry.n_last_used	= 0;
+
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		for (size_t i = 0; i < m_idle.size(); ++i)
+		{
+			const WebPPicture *idle = m_idle[i].picture;
+
+			if (idle->width == width && idle->height == height && (idle->use_argb != 0) == b_use_argb && m_idle[i].b_has_alpha == b_has_alpha)
+			{
+				entry = m_idle[i];
+
+				m_idle.erase(m_idle.begin() + i);
+
+				m_stats.n_idle_bytes	-= entry.n_bytes;
+				m_stats.n_bytes_in_use	+= entry.n_bytes;
+
+				++m_stats.n_hits;
+
+				m_in_use.push_back(entry);
+
+				break;
+			}
+		}
+	}
+
+	if (!entry.picture)
+	{
+		WebPPicture *picture = new WebPPicture;
+
+		if (!WebPPictureInit(picture))
+		{
+			delete picture;
+			return NULL;
+		}
+
+		picture->width		= width;
+		picture->height		= height;
+		picture->use_argb	= b_use_argb;
+		picture->colorspace	= b_has_alpha ? WEBP_YUV420A : WEBP_YUV420;
+
+		if (!WebPPictureAlloc(picture))
+		{
+			delete picture;
+			return NULL;
+		}
+
+		entry.picture = picture;
+
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		++m_stats.n_misses;
+
+		m_stats.n_bytes_in_use += entry.n_bytes;
+
+		if (m_stats.n_bytes_in_use + m_stats.n_idle_bytes > m_stats.n_peak_bytes)
+		{
+			m_stats.n_peak_bytes = m_stats.n_bytes_in_use + m_stats.n_idle_bytes;
+		}
+
+		m_in_use.push_back(entry);
+	}
+
+	// forget whatever the previous encode attached to the picture
+
+	WebPPicture *picture	= entry.picture;
+
+	picture->writer			= NULL;
+	picture->custom_ptr		= NULL;
+	picture->extra_info		= NULL;
+	picture->stats			= NULL;
+	picture->progress_hook	= NULL;
+	picture->user_data		= NULL;
+	picture->error_code		= VP8_ENC_OK;
+
+	return picture;
+}
+
+void WebpPicturePool::Release( _In_ WebPPicture *picture )
+{
+	if (!picture)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	for (size_t i = 0; i < m_in_use.size(); ++i)
+	{
+		if (m_in_use[i].picture == picture)
+		{
+			Entry entry = m_in_use[i];
+
+			m_in_use.erase(m_in_use.begin() + i);
+
+			m_stats.n_bytes_in_use	-= entry.n_bytes;
+			m_stats.n_idle_bytes	+= entry.n_bytes;
+
+			entry.n_last_used		= ++n_clock;
+
+			m_idle.push_back(entry);
+
+			TrimLocked();
+
+			return;
+		}
+	}
+}
+
+void WebpPicturePool::SetMaxIdleBytes( _In_ size_t n_max_idle )
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	n_max_idle_bytes = n_max_idle;
+
+	TrimLocked();
+}
+
+void WebpPicturePool::Clear( )
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	for (size_t i = 0; i < m_idle.size(); ++i)
+	{
+		WebPPictureFree(m_idle[i].picture);
+
+		delete m_idle[i].picture;
+	}
+
+	m_idle.clear();
+
+	m_stats.n_idle_bytes = 0;
+}
+
+WebpPicturePoolStats WebpPicturePool::GetStats( ) const
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	WebpPicturePoolStats stats	= m_stats;
+
+	stats.n_idle_pictures		= m_idle.size();
+
+	return stats;
+}
+
+/*
+* Frees the least recently used idle pictures until the idle memory fits under the cap
+*/
+void WebpPicturePool::TrimLocked( )
+{
+	while (m_stats.n_idle_bytes > n_max_idle_bytes && !m_idle.empty())
+	{
+		size_t n_oldest = 0;
+
+		for (size_t i = 1; i < m_idle.size(); ++i)
+		{
+			if (m_idle[i].n_last_used < m_idle[n_oldest].n_last_used)
+			{
+				n_oldest = i;
+			}
+		}
+
+		m_stats.n_idle_bytes -= m_idle[n_oldest].n_bytes;
+
+		++m_stats.n_evictions;
+
+		WebPPictureFree(m_idle[n_oldest].picture);
+
+		delete m_idle[n_oldest].picture;
+
+		m_idle.erase(m_idle.begin() + n_oldest);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Converts rows of packed RGB(A) straight into the existing planes of a pooled picture
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool WebpPicturePool::ImportPackedRows( _Inout_ WebPPicture *picture, _In_ const uint8_t* data, _In_ int stride, _In_ const WebpPackedLayout &layout, _In_ int first_row, _In_ int n_rows )
+{
+	if (!picture || !data || layout.n_bytes_per_pixel < 3 || (first_row & 1) || first_row < 0)
+	{
+		return false;
+	}
+
+	const int	width		= picture->width;
+	const int	last_row	= (first_row + n_rows < picture->height) ? first_row + n_rows : picture->height;
+	const int	bpp			= layout.n_bytes_per_pixel;
+	const int	r			= layout.n_r;
+	const int	g			= layout.n_g;
+	const int	b			= layout.n_b;
+	const int	a			= layout.n_a;
+
+	if (picture->use_argb)
+	{
+		for (int y = first_row; y < last_row; ++y)
+		{
+			const uint8_t	*src = data + (size_t)y * stride;
+			uint32_t		*dst = picture->argb + (size_t)y * picture->argb_stride;
+
+			for (int x = 0; x < width; ++x, src += bpp)
+			{
+				const uint32_t alpha = (a >= 0) ? src[a] : 0xffu;
+
+				dst[x] = (alpha << 24) | ((uint32_t)src[r] << 16) | ((uint32_t)src[g] << 8) | src[b];
+			}
+		}
+
+		return true;
+	}
+
+	const WebpGammaTables &tables = GetGammaTables();
+
+	for (int y = first_row; y < last_row; y += 2)
+	{
+		const bool		b_pair	= (y + 1 < last_row);
+		const uint8_t	*row0	= data + (size_t)y * stride;
+		const uint8_t	*row1	= b_pair ? row0 + stride : row0;
+		uint8_t			*dst_y0	= picture->y + (size_t)y * picture->y_stride;
+		uint8_t			*dst_y1	= dst_y0 + picture->y_stride;
+		uint8_t			*dst_u	= picture->u + (size_t)(y >> 1) * picture->uv_stride;
+		uint8_t			*dst_v	= picture->v + (size_t)(y >> 1) * picture->uv_stride;
+
+		for (int x = 0; x < width; x += 2)
+		{
+			const bool		b_pair_x = (x + 1 < width);
+			const uint8_t	*p00 = row0 + x * bpp;
+			const uint8_t	*p10 = row1 + x * bpp;
+			const uint8_t	*p01 = b_pair_x ? p00 + bpp : p00;
+			const uint8_t	*p11 = b_pair_x ? p10 + bpp : p10;
+
+			dst_y0[x] = (uint8_t)RGBToY(p00[r], p00[g], p00[b]);
+
+			if (b_pair_x)
+			{
+				dst_y0[x + 1] = (uint8_t)RGBToY(p01[r], p01[g], p01[b]);
+			}
+
+			if (b_pair)
+			{
+				dst_y1[x] = (uint8_t)RGBToY(p10[r], p10[g], p10[b]);
+
+				if (b_pair_x)
+				{
+					dst_y1[x + 1] = (uint8_t)RGBToY(p11[r], p11[g], p11[b]);
+				}
+			}
+
+			const uint32_t total_a = (a >= 0) ? (uint32_t)p00[a] + p01[a] + p10[a] + p11[a] : 4 * 0xff;
+
+			const int r4 = AverageChannel(tables, p00, p01, p10, p11, b_pair_x, r, a, total_a);
+			const int g4 = AverageChannel(tables, p00, p01, p10, p11, b_pair_x, g, a, total_a);
+			const int b4 = AverageChannel(tables, p00, p01, p10, p11, b_pair_x, b, a, total_a);
+
+			dst_u[x >> 1] = (uint8_t)RGBToU(r4, g4, b4);
+			dst_v[x >> 1] = (uint8_t)RGBToV(r4, g4, b4);
+		}
+	}
+
+	if (picture->a)
+	{
+		for (int y = first_row; y < last_row; ++y)
+		{
+			const uint8_t	*src = data + (size_t)y * stride;
+			uint8_t			*dst = picture->a + (size_t)y * picture->a_stride;
+
+			for (int x = 0; x < width; ++x, src += bpp)
+			{
+				dst[x] = (a >= 0) ? src[a] : 0xff;
+			}
+		}
+	}
+
+	return true;
+}
+
+#endif
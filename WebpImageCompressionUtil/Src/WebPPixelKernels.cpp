@@ -0,0 +1,738 @@
+/********************************************************************************************************************************************************************************************
+* FileName   : WebPPixelKernels.cpp
+* Description: Runtime dispatched SIMD kernels for swizzle and alpha handling
+* Date		 : 17/10/2026
+* Author     : Ramesh Kumar K
+*
+********************************************************************************************************************************************************************************************/
+
+# include "WebPPixelKernels.h"
+# include <atomic>
+# include <mutex>
+# include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+# define WEBP_KERNELS_X86
+#endif
+
+#ifdef WEBP_KERNELS_X86
+
+# if defined(_MSC_VER)
+#  include <intrin.h>
+#  define WEBP_KERNEL_TARGET(isa)
+# else
+#  include <cpuid.h>
+#  define WEBP_KERNEL_TARGET(isa)										__attribute__((target(isa)))
+# endif
+
+# include <emmintrin.h>
+# include <tmmintrin.h>
+# include <immintrin.h>
+
+#endif
+
+#define MFIX															24		// fixed point of the unmultiply, as in libwebp
+#define HALF															((1u << MFIX) >> 1)
+
+static uint32_t															kUnmultScale[256];		// (255 << MFIX) / a, 0 for a == 0
+
+static inline uint32_t Div255( uint32_t v )		// round(v / 255) for v <= 255 * 255
+{
+	v += 128;
+
+	return (v + (v >> 8)) >> 8;
+}
+
+static inline uint32_t BlendDiv255( uint32_t v )		// v / 255 with the rounding of libwebp's WebPBlendAlpha, so blended pictures encode the same
+{
+	return (v * 0x101 + 256) >> 16;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Scalar kernels, also used for the tail of the rows in the SIMD versions
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void ShuffleScalar( const uint8_t* src, uint8_t* dst, int n_pixels, const uint8_t order[4] )
+{
+	for (int i = 0; i < n_pixels; ++i, src += 4, dst += 4)
+	{
+		const uint8_t p[4] = { src[0], src[1], src[2], src[3] };
+
+		dst[0] = p[order[0]];
+		dst[1] = p[order[1]];
+		dst[2] = p[order[2]];
+		dst[3] = p[order[3]];
+	}
+}
+
+static void FillAlphaScalar( uint32_t* pixels, int n_pixels )
+{
+	for (int i = 0; i < n_pixels; ++i)
+	{
+		pixels[i] |= 0xff000000u;
+	}
+}
+
+static void PremultiplyScalar( uint8_t* pixels, int n_pixels )
+{
+	for (int i = 0; i < n_pixels; ++i, pixels += 4)
+	{
+		const uint32_t a = pixels[3];
+
+		if (a < 255)
+		{
+			pixels[0] = (uint8_t)Div255(pixels[0] * a);
+			pixels[1] = (uint8_t)Div255(pixels[1] * a);
+			pixels[2] = (uint8_t)Div255(pixels[2] * a);
+		}
+	}
+}
+
+static inline uint8_t Unmult( uint8_t x, uint32_t scale )
+{
+	const uint32_t v = (x * scale + HALF) >> MFIX;
+
+	return (uint8_t)((v > 255u) ? 255u : v);
+}
+
+static void UnpremultiplyScalar( uint8_t* pixels, int n_pixels )
+{
+	for (int i = 0; i < n_pixels; ++i, pixels += 4)
+	{
+		const uint32_t a = pixels[3];
+
+		if (a < 255)
+		{
+			const uint32_t scale = kUnmultScale[a];
+
+			pixels[0] = Unmult(pixels[0], scale);
+			pixels[1] = Unmult(pixels[1], scale);
+			pixels[2] = Unmult(pixels[2], scale);
+		}
+	}
+}
+
+static void BlendToBackgroundScalar( uint8_t* pixels, int n_pixels, uint32_t background )
+{
+	const uint32_t bg[3] = { background & 0xff, (background >> 8) & 0xff, (background >> 16) & 0xff };
+
+	for (int i = 0; i < n_pixels; ++i, pixels += 4)
+	{
+		const uint32_t a = pixels[3];
+
+		pixels[0] = (uint8_t)BlendDiv255(pixels[0] * a + bg[0] * (255 - a));
+		pixels[1] = (uint8_t)BlendDiv255(pixels[1] * a + bg[1] * (255 - a));
+		pixels[2] = (uint8_t)BlendDiv255(pixels[2] * a + bg[2] * (255 - a));
+		pixels[3] = 0xff;
+	}
+}
+
+#ifdef WEBP_KERNELS_X86
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SSE2, 4 pixels per step. The multiplies are done on 16 bit lanes, c * a <= 255 * 255 fits and Div255 stays exact.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+WEBP_KERNEL_TARGET("sse2")
+static void FillAlphaSSE2( uint32_t* pixels, int n_pixels )
+{
+	const __m128i	alpha	= _mm_set1_epi32((int)0xff000000u);
+
+	int i = 0;
+
+	for (; i + 4 <= n_pixels; i += 4)
+	{
+		const __m128i p = _mm_loadu_si128((const __m128i*)(pixels + i));
+
+		_mm_storeu_si128((__m128i*)(pixels + i), _mm_or_si128(p, alpha));
+	}
+
+	FillAlphaScalar(pixels + i, n_pixels - i);
+}
+
+WEBP_KERNEL_TARGET("sse2")
+static inline __m128i Div255SSE2( __m128i v )		// 16 bit lanes
+{
+	v = _mm_add_epi16(v, _mm_set1_epi16(128));
+
+	return _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+}
+
+WEBP_KERNEL_TARGET("sse2")
+static inline __m128i BlendDiv255SSE2( __m128i v )		// ((v + 1) * 257) >> 16 equals (v * 0x101 + 256) >> 16 for v <= 255 * 255
+{
+	return _mm_mulhi_epu16(_mm_add_epi16(v, _mm_set1_epi16(1)), _mm_set1_epi16(257));
+}
+
+WEBP_KERNEL_TARGET("sse2")
+static inline __m128i BroadcastAlphaSSE2( __m128i p16 )		// 2 pixels on 16 bit lanes, alpha copied to the 4 lanes of its pixel
+{
+	return _mm_shufflehi_epi16(_mm_shufflelo_epi16(p16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+WEBP_KERNEL_TARGET("sse2")
+static void PremultiplySSE2( uint8_t* pixels, int n_pixels )
+{
+	const __m128i	zero		= _mm_setzero_si128();
+	const __m128i	alpha_lanes	= _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+	const __m128i	c255		= _mm_set1_epi16(255);
+
+	int i = 0;
+
+	for (; i + 4 <= n_pixels; i += 4)
+	{
+		const __m128i	p	= _mm_loadu_si128((const __m128i*)(pixels + 4 * i));
+
+		__m128i			lo	= _mm_unpacklo_epi8(p, zero);
+		__m128i			hi	= _mm_unpackhi_epi8(p, zero);
+
+		// alpha * 255 / 255 keeps the alpha lane as it is
+
+		const __m128i	a_lo = _mm_or_si128(_mm_andnot_si128(alpha_lanes, BroadcastAlphaSSE2(lo)), _mm_and_si128(alpha_lanes, c255));
+		const __m128i	a_hi = _mm_or_si128(_mm_andnot_si128(alpha_lanes, BroadcastAlphaSSE2(hi)), _mm_and_si128(alpha_lanes, c255));
+
+		lo = Div255SSE2(_mm_mullo_epi16(lo, a_lo));
+		hi = Div255SSE2(_mm_mullo_epi16(hi, a_hi));
+
+		_mm_storeu_si128((__m128i*)(pixels + 4 * i), _mm_packus_epi16(lo, hi));
+	}
+
+	PremultiplyScalar(pixels + 4 * i, n_pixels - i);
+}
+
+/*
+* The division has no exact SIMD form without 32 bit multiplies, so only runs of opaque pixels are skipped 4 at a time
+*/
+WEBP_KERNEL_TARGET("sse2")
+static void UnpremultiplySSE2( uint8_t* pixels, int n_pixels )
+{
+	const __m128i	alpha	= _mm_set1_epi32((int)0xff000000u);
+
+	int i = 0;
+
+	for (; i + 4 <= n_pixels; i += 4)
+	{
+		const __m128i p = _mm_loadu_si128((const __m128i*)(pixels + 4 * i));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(p, alpha), alpha)) != 0xffff)
+		{
+			UnpremultiplyScalar(pixels + 4 * i, 4);
+		}
+	}
+
+	UnpremultiplyScalar(pixels + 4 * i, n_pixels - i);
+}
+
+WEBP_KERNEL_TARGET("sse2")
+static void BlendToBackgroundSSE2( uint8_t* pixels, int n_pixels, uint32_t background )
+{
+	const __m128i	zero		= _mm_setzero_si128();
+	const __m128i	c255		= _mm_set1_epi16(255);
+	const __m128i	alpha		= _mm_set1_epi32((int)0xff000000u);
+	const __m128i	bg			= _mm_unpacklo_epi8(_mm_set1_epi32((int)(background & 0x00ffffffu)), zero);
+
+	int i = 0;
+
+	for (; i + 4 <= n_pixels; i += 4)
+	{
+		const __m128i	p		= _mm_loadu_si128((const __m128i*)(pixels + 4 * i));
+
+		const __m128i	lo		= _mm_unpacklo_epi8(p, zero);
+		const __m128i	hi		= _mm_unpackhi_epi8(p, zero);
+		const __m128i	a_lo	= BroadcastAlphaSSE2(lo);
+		const __m128i	a_hi	= BroadcastAlphaSSE2(hi);
+
+		const __m128i	r_lo	= BlendDiv255SSE2(_mm_add_epi16(_mm_mullo_epi16(lo, a_lo), _mm_mullo_epi16(bg, _mm_sub_epi16(c255, a_lo))));
+		const __m128i	r_hi	= BlendDiv255SSE2(_mm_add_epi16(_mm_mullo_epi16(hi, a_hi), _mm_mullo_epi16(bg, _mm_sub_epi16(c255, a_hi))));
+
+		_mm_storeu_si128((__m128i*)(pixels + 4 * i), _mm_or_si128(_mm_packus_epi16(r_lo, r_hi), alpha));
+	}
+
+	BlendToBackgroundScalar(pixels + 4 * i, n_pixels - i, background);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SSSE3, pshufb does any byte order in one instruction
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+WEBP_KERNEL_TARGET("ssse3")
+static void ShuffleSSSE3( const uint8_t* src, uint8_t* dst, int n_pixels, const uint8_t order[4] )
+{
+	const __m128i	mask	= _mm_setr_epi8(	(char)order[0],      (char)order[1],      (char)order[2],      (char)order[3],
+												(char)(order[0] + 4), (char)(order[1] + 4), (char)(order[2] + 4), (char)(order[3] + 4),
+												(char)(order[0] + 8), (char)(order[1] + 8), (char)(order[2] + 8), (char)(order[3] + 8),
+												(char)(order[0] + 12), (char)(order[1] + 12), (char)(order[2] + 12), (char)(order[3] + 12));
+	int i = 0;
+
+	for (; i + 4 <= n_pixels; i += 4)
+	{
+		const __m128i p = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+
+		_mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_shuffle_epi8(p, mask));
+	}
+
+	ShuffleScalar(src + 4 * i, dst + 4 * i, n_pixels - i, order);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// AVX2, 8 pixels per step. The unmultiply gathers the scale of each pixel and uses 32 bit multiplies, which wrap exactly like the scalar code.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+WEBP_KERNEL_TARGET("avx2")
+static void ShuffleAVX2( const uint8_t* src, uint8_t* dst, int n_pixels, const uint8_t order[4] )
+{
+	uint8_t			bytes[32];
+
+	for (int j = 0; j < 32; ++j)
+	{
+		bytes[j] = (uint8_t)((j & 12) + order[j & 3]);		// vpshufb works inside each 128 bit lane, the same pattern twice
+	}
+
+	const __m256i	mask	= _mm256_loadu_si256((const __m256i*)bytes);
+
+	int i = 0;
+
+	for (; i + 8 <= n_pixels; i += 8)
+	{
+		const __m256i p = _mm256_loadu_si256((const __m256i*)(src + 4 * i));
+
+		_mm256_storeu_si256((__m256i*)(dst + 4 * i), _mm256_shuffle_epi8(p, mask));
+	}
+
+	ShuffleScalar(src + 4 * i, dst + 4 * i, n_pixels - i, order);
+}
+
+WEBP_KERNEL_TARGET("avx2")
+static void FillAlphaAVX2( uint32_t* pixels, int n_pixels )
+{
+	const __m256i	alpha	= _mm256_set1_epi32((int)0xff000000u);
+
+	int i = 0;
+
+	for (; i + 8 <= n_pixels; i += 8)
+	{
+		const __m256i p = _mm256_loadu_si256((const __m256i*)(pixels + i));
+
+		_mm256_storeu_si256((__m256i*)(pixels + i), _mm256_or_si256(p, alpha));
+	}
+
+	FillAlphaScalar(pixels + i, n_pixels - i);
+}
+
+WEBP_KERNEL_TARGET("avx2")
+static inline __m256i Div255AVX2( __m256i v )
+{
+	v = _mm256_add_epi16(v, _mm256_set1_epi16(128));
+
+	return _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+}
+
+WEBP_KERNEL_TARGET("avx2")
+static inline __m256i BlendDiv255AVX2( __m256i v )
+{
+	return _mm256_mulhi_epu16(_mm256_add_epi16(v, _mm256_set1_epi16(1)), _mm256_set1_epi16(257));
+}
+
+WEBP_KERNEL_TARGET("avx2")
+static inline __m256i BroadcastAlphaAVX2( __m256i p16 )
+{
+	return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(p16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+WEBP_KERNEL_TARGET("avx2")
+static void PremultiplyAVX2( uint8_t* pixels, int n_pixels )
+{
+	const __m256i	zero		= _mm256_setzero_si256();
+	const __m256i	alpha_lanes	= _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+	const __m256i	c255		= _mm256_set1_epi16(255);
+
+	int i = 0;
+
+	for (; i + 8 <= n_pixels; i += 8)
+	{
+		const __m256i	p	= _mm256_loadu_si256((const __m256i*)(pixels + 4 * i));
+
+		__m256i			lo	= _mm256_unpacklo_epi8(p, zero);
+		__m256i			hi	= _mm256_unpackhi_epi8(p, zero);
+
+		const __m256i	a_lo = _mm256_or_si256(_mm256_andnot_si256(alpha_lanes, BroadcastAlphaAVX2(lo)), _mm256_and_si256(alpha_lanes, c255));
+		const __m256i	a_hi = _mm256_or_si256(_mm256_andnot_si256(alpha_lanes, BroadcastAlphaAVX2(hi)), _mm256_and_si256(alpha_lanes, c255));
+
+		lo = Div255AVX2(_mm256_mullo_epi16(lo, a_lo));
+		hi = Div255AVX2(_mm256_mullo_epi16(hi, a_hi));
+
+		_mm256_storeu_si256((__m256i*)(pixels + 4 * i), _mm256_packus_epi16(lo, hi));		// unpack and pack are both per lane, the order is kept
+	}
+
+	PremultiplyScalar(pixels + 4 * i, n_pixels - i);
+}
+
+WEBP_KERNEL_TARGET("avx2")
+static void UnpremultiplyAVX2( uint8_t* pixels, int n_pixels )
+{
+	const __m256i	mask_c		= _mm256_set1_epi32(0xff);
+	const __m256i	mask_a		= _mm256_set1_epi32((int)0xff000000u);
+	const __m256i	half		= _mm256_set1_epi32((int)HALF);
+
+	int i = 0;
+
+	for (; i + 8 <= n_pixels; i += 8)
+	{
+		const __m256i	p		= _mm256_loadu_si256((const __m256i*)(pixels + 4 * i));
+		const __m256i	scale	= _mm256_i32gather_epi32((const int*)kUnmultScale, _mm256_srli_epi32(p, 24), 4);
+
+		__m256i			out		= _mm256_and_si256(p, mask_a);
+
+		for (int c = 0; c < 3; ++c)
+		{
+			const __m256i	x	= _mm256_and_si256(_mm256_srli_epi32(p, 8 * c), mask_c);
+
+			__m256i			v	= _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(x, scale), half), MFIX);
+
+			v = _mm256_min_epu32(v, mask_c);
+
+			out = _mm256_or_si256(out, _mm256_slli_epi32(v, 8 * c));
+		}
+
+		_mm256_storeu_si256((__m256i*)(pixels + 4 * i), out);
+	}
+
+	UnpremultiplyScalar(pixels + 4 * i, n_pixels - i);
+}
+
+WEBP_KERNEL_TARGET("avx2")
+static void BlendToBackgroundAVX2( uint8_t* pixels, int n_pixels, uint32_t background )
+{
+	const __m256i	zero		= _mm256_setzero_si256();
+	const __m256i	c255		= _mm256_set1_epi16(255);
+	const __m256i	alpha		= _mm256_set1_epi32((int)0xff000000u);
+	const __m256i	bg			= _mm256_unpacklo_epi8(_mm256_set1_epi32((int)(background & 0x00ffffffu)), zero);
+
+	int i = 0;
+
+	for (; i + 8 <= n_pixels; i += 8)
+	{
+		const __m256i	p		= _mm256_loadu_si256((const __m256i*)(pixels + 4 * i));
+
+		const __m256i	lo		= _mm256_unpacklo_epi8(p, zero);
+		const __m256i	hi		= _mm256_unpackhi_epi8(p, zero);
+		const __m256i	a_lo	= BroadcastAlphaAVX2(lo);
+		const __m256i	a_hi	= BroadcastAlphaAVX2(hi);
+
+		const __m256i	r_lo	= BlendDiv255AVX2(_mm256_add_epi16(_mm256_mullo_epi16(lo, a_lo), _mm256_mullo_epi16(bg, _mm256_sub_epi16(c255, a_lo))));
+		const __m256i	r_hi	= BlendDiv255AVX2(_mm256_add_epi16(_mm256_mullo_epi16(hi, a_hi), _mm256_mullo_epi16(bg, _mm256_sub_epi16(c255, a_hi))));
+
+		_mm256_storeu_si256((__m256i*)(pixels + 4 * i), _mm256_or_si256(_mm256_packus_epi16(r_lo, r_hi), alpha));
+	}
+
+	BlendToBackgroundScalar(pixels + 4 * i, n_pixels - i, background);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// CPU detection
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void GetCpuId( int leaf, int info[4] )
+{
+#if defined(_MSC_VER)
+	__cpuidex(info, leaf, 0);
+#else
+	unsigned int a = 0, b = 0, c = 0, d = 0;
+
+	__cpuid_count(leaf, 0, a, b, c, d);
+
+	info[0] = (int)a; info[1] = (int)b; info[2] = (int)c; info[3] = (int)d;
+#endif
+}
+
+static uint64_t GetXCR0( )
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+
+	__asm__ volatile(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0));		// xgetbv, spelled out for assemblers without it
+
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+#endif
+
+WEBP_KERNEL_ISA WebpGetCpuKernelIsa( void )
+{
+#ifdef WEBP_KERNELS_X86
+
+	int info[4] = { 0, 0, 0, 0 };
+
+	GetCpuId(0, info);
+
+	const int n_max_leaf = info[0];
+
+	GetCpuId(1, info);
+
+	const bool b_sse2		= (info[3] & (1 << 26)) != 0;
+	const bool b_ssse3		= (info[2] & (1 << 9)) != 0;
+	const bool b_sse41		= (info[2] & (1 << 19)) != 0;
+	const bool b_osxsave	= (info[2] & (1 << 27)) != 0;
+	const bool b_avx		= (info[2] & (1 << 28)) != 0;
+
+	bool b_avx2 = false;
+
+	if (n_max_leaf >= 7 && b_osxsave && b_avx && (GetXCR0() & 6) == 6)		// the OS saves the YMM registers
+	{
+		GetCpuId(7, info);
+
+		b_avx2 = (info[1] & (1 << 5)) != 0;
+	}
+
+	if (b_avx2 && b_sse41 && b_ssse3 && b_sse2)
+	{
+		return WEBP_KERNEL_ISA_AVX2;
+	}
+
+	if (b_sse41 && b_ssse3 && b_sse2)
+	{
+		return WEBP_KERNEL_ISA_SSE41;
+	}
+
+	if (b_ssse3 && b_sse2)
+	{
+		return WEBP_KERNEL_ISA_SSSE3;
+	}
+
+	if (b_sse2)
+	{
+		return WEBP_KERNEL_ISA_SSE2;
+	}
+
+#endif
+
+	return WEBP_KERNEL_ISA_SCALAR;
+}
+
+static WebpPixelKernels BuildKernels( WEBP_KERNEL_ISA n_isa )
+{
+	WebpPixelKernels kernels;
+
+	kernels.ptr_shuffle					= ShuffleScalar;
+	kernels.ptr_fill_alpha				= FillAlphaScalar;
+	kernels.ptr_premultiply				= PremultiplyScalar;
+	kernels.ptr_unpremultiply			= UnpremultiplyScalar;
+	kernels.ptr_blend_to_background		= BlendToBackgroundScalar;
+	kernels.n_isa						= n_isa;
+
+#ifdef WEBP_KERNELS_X86
+
+	if (n_isa >= WEBP_KERNEL_ISA_SSE2)
+	{
+		kernels.ptr_fill_alpha			= FillAlphaSSE2;
+		kernels.ptr_premultiply			= PremultiplySSE2;
+		kernels.ptr_unpremultiply		= UnpremultiplySSE2;
+		kernels.ptr_blend_to_background	= BlendToBackgroundSSE2;
+	}
+
+	if (n_isa >= WEBP_KERNEL_ISA_SSSE3)
+	{
+		kernels.ptr_shuffle				= ShuffleSSSE3;
+	}
+
+	if (n_isa >= WEBP_KERNEL_ISA_AVX2)
+	{
+		kernels.ptr_shuffle				= ShuffleAVX2;
+		kernels.ptr_fill_alpha			= FillAlphaAVX2;
+		kernels.ptr_premultiply			= PremultiplyAVX2;
+		kernels.ptr_unpremultiply		= UnpremultiplyAVX2;
+		kernels.ptr_blend_to_background	= BlendToBackgroundAVX2;
+	}
+
+#else
+
+	kernels.n_isa						= WEBP_KERNEL_ISA_SCALAR;
+
+#endif
+
+	return kernels;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Tables for every instruction set up to the CPU's best, the ceiling only selects one of them
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static WebpPixelKernels													kKernelTables[WEBP_KERNEL_ISA_COUNT];
+
+static WEBP_KERNEL_ISA													kCpuIsa = WEBP_KERNEL_ISA_SCALAR;
+
+static std::atomic<int>													s_isa_ceiling(WEBP_KERNEL_ISA_AVX2);
+
+static bool InitKernels( )
+{
+	kUnmultScale[0] = 0;
+
+	for (uint32_t a = 1; a < 256; ++a)
+	{
+		kUnmultScale[a] = (255u << MFIX) / a;
+	}
+
+	kCpuIsa = WebpGetCpuKernelIsa();
+
+	for (int n_isa = 0; n_isa < WEBP_KERNEL_ISA_COUNT; ++n_isa)
+	{
+		kKernelTables[n_isa] = BuildKernels(n_isa <= kCpuIsa ? (WEBP_KERNEL_ISA)n_isa : kCpuIsa);
+	}
+
+	return true;
+}
+
+static void EnsureKernels( )
+{
+	static const bool b_ready = InitKernels();		// thread safe one time init
+
+	(void)b_ready;
+}
+
+WEBP_KERNEL_ISA WebpGetActiveIsa( void )
+{
+	EnsureKernels();
+
+	const int n_ceiling = s_isa_ceiling.load(std::memory_order_relaxed);
+
+	return (n_ceiling < kCpuIsa) ? (WEBP_KERNEL_ISA)n_ceiling : kCpuIsa;
+}
+
+const WebpPixelKernels* WebpGetPixelKernels( void )
+{
+	return &kKernelTables[WebpGetActiveIsa()];
+}
+
+WEBP_KERNEL_ISA WebpGetIsaCeiling( void )
+{
+	return (WEBP_KERNEL_ISA)s_isa_ceiling.load(std::memory_order_relaxed);
+}
+
+const char* WebpGetIsaName( WEBP_KERNEL_ISA n_isa )
+{
+	switch (n_isa)
+	{
+	case WEBP_KERNEL_ISA_SCALAR:	return "scalar";
+	case WEBP_KERNEL_ISA_SSE2:		return "sse2";
+	case WEBP_KERNEL_ISA_SSSE3:		return "ssse3";
+	case WEBP_KERNEL_ISA_SSE41:		return "sse4.1";
+	case WEBP_KERNEL_ISA_AVX2:		return "avx2";
+	default:						return "unknown";
+	}
+}
+
+#if defined(_USE_WEBP_) && !defined(WEBP_DLL)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// libwebp asks VP8GetCPUInfo before installing each of its SSE2/SSE4.1/AVX2 functions. The hook isn't in the public headers, so its type is
+// repeated here; the feature list must stay in the order of CPUFeature in libwebp's src/dsp/dsp.h. A DLL build doesn't export the hook.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef enum
+{
+	kLibwebpSSE2,
+	kLibwebpSSE3,
+	kLibwebpSlowSSSE3,
+	kLibwebpSSE4_1,
+	kLibwebpAVX,
+	kLibwebpAVX2,
+	kLibwebpNEON,
+	kLibwebpMIPS32,
+	kLibwebpMIPSdspR2,
+	kLibwebpMSA
+} LibwebpCpuFeature;
+
+extern "C"
+{
+	typedef int (*VP8CPUInfo)( LibwebpCpuFeature feature );
+
+	extern VP8CPUInfo VP8GetCPUInfo;
+}
+
+static VP8CPUInfo														s_libwebp_cpu_info = NULL;		// libwebp's own detection
+
+static bool IsFeatureAllowed( LibwebpCpuFeature feature, int n_ceiling )
+{
+	switch (feature)
+	{
+	case kLibwebpSSE2:			return n_ceiling >= WEBP_KERNEL_ISA_SSE2;
+	case kLibwebpSSE3:
+	case kLibwebpSlowSSSE3:		return n_ceiling >= WEBP_KERNEL_ISA_SSSE3;
+	case kLibwebpSSE4_1:		return n_ceiling >= WEBP_KERNEL_ISA_SSE41;
+	case kLibwebpAVX:
+	case kLibwebpAVX2:			return n_ceiling >= WEBP_KERNEL_ISA_AVX2;
+	default:					return true;		// not x86, the ceiling doesn't apply
+	}
+}
+
+/*
+* One hook per ceiling: libwebp only re-runs its DSP init when the VP8GetCPUInfo pointer changes, so the pointer has to change with the ceiling
+*/
+template <int kCeiling>
+static int CpuInfoWithCeiling( LibwebpCpuFeature feature )
+{
+	return IsFeatureAllowed(feature, kCeiling) && s_libwebp_cpu_info && s_libwebp_cpu_info(feature);
+}
+
+static const VP8CPUInfo													kCpuInfoHooks[WEBP_KERNEL_ISA_COUNT] =
+{
+	CpuInfoWithCeiling<WEBP_KERNEL_ISA_SCALAR>,
+	CpuInfoWithCeiling<WEBP_KERNEL_ISA_SSE2>,
+	CpuInfoWithCeiling<WEBP_KERNEL_ISA_SSSE3>,
+	CpuInfoWithCeiling<WEBP_KERNEL_ISA_SSE41>,
+	CpuInfoWithCeiling<WEBP_KERNEL_ISA_AVX2>
+};
+
+static void ApplyLibwebpCeiling( int n_ceiling )
+{
+	static std::mutex													s_hook_lock;
+
+	std::lock_guard<std::mutex> guard(s_hook_lock);
+
+	bool b_hooked = false;
+
+	for (int i = 0; i < WEBP_KERNEL_ISA_COUNT; ++i)
+	{
+		b_hooked = b_hooked || (VP8GetCPUInfo == kCpuInfoHooks[i]);
+	}
+
+	if (!b_hooked)
+	{
+		s_libwebp_cpu_info = VP8GetCPUInfo;
+	}
+
+	VP8GetCPUInfo = kCpuInfoHooks[n_ceiling];
+}
+
+#endif
+
+void WebpSetIsaCeiling( WEBP_KERNEL_ISA n_ceiling )
+{
+	if (n_ceiling < WEBP_KERNEL_ISA_SCALAR || n_ceiling >= WEBP_KERNEL_ISA_COUNT)
+	{
+		n_ceiling = WEBP_KERNEL_ISA_AVX2;
+	}
+
+	s_isa_ceiling.store(n_ceiling, std::memory_order_relaxed);
+
+#if defined(_USE_WEBP_) && !defined(WEBP_DLL)
+	ApplyLibwebpCeiling(n_ceiling);
+#endif
+}
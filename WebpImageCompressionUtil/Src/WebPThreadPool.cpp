@@ -0,0 +1,235 @@
+/********************************************************************************************************************************************************************************************
+* FileName   : WebPThreadPool.cpp
+* Description: Work-stealing thread pool used by the encoder for batch and parallel jobs
+* Date		 : 17/10/2026
+* Author     : Ramesh Kumar K
+*
+********************************************************************************************************************************************************************************************/
+
+# include "WebPThreadPool.h"
+
+/*
+* Constructor, spawns n_threads - 1 workers as the thread calling ParallelFor takes part in the work
+*/
+WebpThreadPool::WebpThreadPool( unsigned int n_threads )
+{
+	m_task								= NULL;
+
+	m_pending							= 0;
+
+	m_active_workers					= 0;
+
+	m_generation						= 0;
+
+	b_stop								= false;
+
+	if (n_threads == 0)
+	{
+		n_threads = GetHardwareThreadCount();
+	}
+
+	for (unsigned int i = 0; i < n_threads; ++i)
+	{
+		m_queues.push_back(new WorkQueue());
+	}
+
+	for (unsigned int i = 1; i < n_threads; ++i)
+	{
+		m_threads.push_back(std::thread(&WebpThreadPool::WorkerLoop, this, i));
+	}
+}
+
+/*
+* Destructor
+*/
+WebpThreadPool::~WebpThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_state_lock);
+
+		b_stop = true;
+	}
+
+	m_wake.notify_all();
+
+	for (size_t i = 0; i < m_threads.size(); ++i)
+	{
+		m_threads[i].join();
+	}
+
+	for (size_t i = 0; i < m_queues.size(); ++i)
+	{
+		delete m_queues[i];
+	}
+}
+
+unsigned int WebpThreadPool::GetThreadCount( ) const
+{
+	return (unsigned int)m_queues.size();
+}
+
+unsigned int WebpThreadPool::GetHardwareThreadCount( )
+{
+	const unsigned int n_threads = std::thread::hardware_concurrency();
+
+	return n_threads > 0 ? n_threads : 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Runs task for every index in [0, n_count). The indices are split in contiguous ranges, one per worker, so neighbouring jobs stay on the same core
+// unless the worker falls behind and gets robbed.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void WebpThreadPool::ParallelFor( _In_ size_t n_count, _In_ const Task &task )
+{
+	if (n_count == 0)
+	{
+		return;
+	}
+
+	if (m_threads.empty() || n_count == 1)
+	{
+		for (size_t i = 0; i < n_count; ++i)
+		{
+			task(i, 0);
+		}
+
+		return;
+	}
+
+	std::lock_guard<std::mutex> job_guard(m_job_lock);
+
+	const size_t n_queues = m_queues.size();
+
+	for (size_t q = 0; q < n_queues; ++q)
+	{
+		const size_t first	= n_count * q / n_queues;
+		const size_t last	= n_count * (q + 1) / n_queues;
+
+		std::lock_guard<std::mutex> guard(m_queues[q]->lock);
+
+		m_queues[q]->items.clear();
+
+		for (size_t i = first; i < last; ++i)
+		{
+			m_queues[q]->items.push_back(i);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(m_state_lock);
+
+		m_task		= &task;
+		m_pending	= n_count;
+
+		++m_generation;
+	}
+
+	m_wake.notify_all();
+
+	RunTasks(0);
+
+	std::unique_lock<std::mutex> lock(m_state_lock);
+
+	m_done.wait(lock, [this] { return m_pending == 0 && m_active_workers == 0; });
+
+	m_task = NULL;		// workers waking up late must not pick up a finished job
+}
+
+void WebpThreadPool::WorkerLoop( unsigned int n_worker_id )
+{
+	unsigned long long seen_generation = 0;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_state_lock);
+
+			m_wake.wait(lock, [&] { return b_stop || seen_generation != m_generation; });
+
+			if (b_stop)
+			{
+				return;
+			}
+
+			seen_generation = m_generation;
+
+			if (m_task == NULL)
+			{
+				continue;
+			}
+
+			++m_active_workers;
+		}
+
+		RunTasks(n_worker_id);
+
+		{
+			std::lock_guard<std::mutex> guard(m_state_lock);
+
+			--m_active_workers;
+		}
+
+		m_done.notify_all();
+	}
+}
+
+void WebpThreadPool::RunTasks( unsigned int n_worker_id )
+{
+	size_t n_index = 0;
+
+	while (PopTask(n_worker_id, n_index))
+	{
+		(*m_task)(n_index, n_worker_id);
+
+		if (--m_pending == 0)
+		{
+			std::lock_guard<std::mutex> guard(m_state_lock);
+
+			m_done.notify_all();
+		}
+	}
+}
+
+/*
+* Takes the next job from the worker's own queue, or steals the last job of another worker
+*/
+bool WebpThreadPool::PopTask( unsigned int n_worker_id, size_t &n_index )
+{
+	{
+		WorkQueue *own = m_queues[n_worker_id];
+
+		std::lock_guard<std::mutex> guard(own->lock);
+
+		if (!own->items.empty())
+		{
+			n_index = own->items.front();
+
+			own->items.pop_front();
+
+			return true;
+		}
+	}
+
+	const size_t n_queues = m_queues.size();
+
+	for (size_t i = 1; i < n_queues; ++i)
+	{
+		WorkQueue *victim = m_queues[(n_worker_id + i) % n_queues];
+
+		std::lock_guard<std::mutex> guard(victim->lock);
+
+		if (!victim->items.empty())
+		{
+			n_index = victim->items.back();
+
+			victim->items.pop_back();
+
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -11,6 +11,8 @@
 
 #ifdef _USE_WEBP_
 #include "imageio/image_dec.h"
+#include "webp/encode.h"
+#include "WebPMetrics.h"
 #endif
 
 #ifdef _USE_WEBP_
@@ -53,6 +55,50 @@ static int FailReader(const uint8_t* const data, size_t data_size,
   return 0;
 }
 
+#ifndef WEBP_NO_METRICS
+
+// Readers handed out by WebPGetImageReader() report to the metrics registry.
+// The readers only return success or failure, so failures are counted with
+// code 1.
+static int MeteredRead(WEBP_METRIC_OP op, WebPImageReader reader,
+                       const uint8_t* const data, size_t data_size,
+                       struct WebPPicture* const pic,
+                       int keep_alpha, struct Metadata* const metadata) {
+  WEBP_METRICS_START(start);
+  const int ok = reader(data, data_size, pic, keep_alpha, metadata);
+  const uint64_t pixels = ok ? (uint64_t)pic->width * pic->height : 0;
+  WEBP_METRICS_RECORD(op, start, pixels, data_size, 0, ok ? 0 : 1);
+  return ok;
+}
+
+#define METERED_READER(NAME, OP)                                          \
+static int Metered##NAME(const uint8_t* const data, size_t data_size,     \
+                         struct WebPPicture* const pic,                   \
+                         int keep_alpha, struct Metadata* const metadata) { \
+  return MeteredRead(OP, NAME, data, data_size, pic, keep_alpha, metadata); \
+}
+
+METERED_READER(ReadPNG, WEBP_METRIC_OP_READ_PNG)
+METERED_READER(ReadJPEG, WEBP_METRIC_OP_READ_JPEG)
+METERED_READER(ReadTIFF, WEBP_METRIC_OP_READ_TIFF)
+METERED_READER(ReadWebP, WEBP_METRIC_OP_READ_WEBP)
+METERED_READER(ReadPNM, WEBP_METRIC_OP_READ_PNM)
+
+#undef METERED_READER
+
+WebPImageReader WebPGetImageReader(WebPInputFileFormat format) {
+  switch (format) {
+    case WEBP_PNG_FORMAT: return MeteredReadPNG;
+    case WEBP_JPEG_FORMAT: return MeteredReadJPEG;
+    case WEBP_TIFF_FORMAT: return MeteredReadTIFF;
+    case WEBP_WEBP_FORMAT: return MeteredReadWebP;
+    case WEBP_PNM_FORMAT: return MeteredReadPNM;
+    default: return FailReader;
+  }
+}
+
+#else
+
 WebPImageReader WebPGetImageReader(WebPInputFileFormat format) {
   switch (format) {
     case WEBP_PNG_FORMAT: return ReadPNG;
@@ -64,6 +110,8 @@ WebPImageReader WebPGetImageReader(WebPInputFileFormat format) {
   }
 }
 
+#endif  // WEBP_NO_METRICS
+
 WebPImageReader WebPGuessImageReader(const uint8_t* const data,
                                      size_t data_size) {
   return WebPGetImageReader(WebPGuessImageType(data, data_size));
@@ -10,15 +10,27 @@
 //  Utility functions used by the image decoders.
 //
 
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L   // mmap() and posix_madvise() in strict C99
+#endif
+
 #include "imageio/imageio_util.h"
 
 #if defined(_WIN32)
 #include <fcntl.h>   // for _O_BINARY
 #include <io.h>      // for _setmode()
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-# include "tchar.h"
+#include "WebPPlatform.h"
 
 // -----------------------------------------------------------------------------
 // File I/O
@@ -33,74 +45,254 @@ FILE* ImgIoUtilSetBinaryMode(FILE* file) {
   return file;
 }
 
-int ImgIoUtilReadFromStdin(const uint8_t** data, size_t* data_size) {
+// Reads 'in' until EOF into a malloc'd buffer.
+static int ReadFromStream(FILE* const in,
+                          const uint8_t** data, size_t* data_size) {
   static const size_t kBlockSize = 16384;  // default initial size
   size_t max_size = 0;
   size_t size = 0;
   uint8_t* input = NULL;
 
-  if (data == NULL || data_size == NULL) return 0;
-  *data = NULL;
-  *data_size = 0;
-
-  if (!ImgIoUtilSetBinaryMode(stdin)) return 0;
-
-  while (!feof(stdin)) {
+  while (!feof(in)) {
     // We double the buffer size each time and read as much as possible.
     const size_t extra_size = (max_size == 0) ? kBlockSize : max_size;
     void* const new_data = realloc(input, max_size + extra_size);
     if (new_data == NULL) goto Error;
     input = (uint8_t*)new_data;
     max_size += extra_size;
-    size += fread(input + size, 1, extra_size, stdin);
+    size += fread(input + size, 1, extra_size, in);
     if (size < max_size) break;
   }
-  if (ferror(stdin)) goto Error;
+  if (ferror(in)) goto Error;
   *data = input;
   *data_size = size;
   return 1;
 
  Error:
   free(input);
-  fprintf(stderr, "Could not read from stdin\n");
   return 0;
 }
 
+int ImgIoUtilReadFromStdin(const uint8_t** data, size_t* data_size) {
+  if (data == NULL || data_size == NULL) return 0;
+  *data = NULL;
+  *data_size = 0;
+
+  if (!ImgIoUtilSetBinaryMode(stdin)) return 0;
+
+  if (!ReadFromStream(stdin, data, data_size)) {
+    fprintf(stderr, "Could not read from stdin\n");
+    return 0;
+  }
+  return 1;
+}
+
+// -----------------------------------------------------------------------------
+// File views
+
+static const uint8_t kEmptyFile[1] = { 0 };
+
+static int IsStdin(const char* const file_name) {
+  return (file_name == NULL) || !strcmp(file_name, "-");
+}
+
+#if !defined(_WIN32)
+
+// Reads 'fd' until EOF. 'size_hint' is the size of a regular file, the buffer
+// gets one spare byte so that the read which reports EOF doesn't grow it.
+static int ReadFdToView(int fd, size_t size_hint,
+                        ImgIoUtilFileView* const view) {
+  static const size_t kBlockSize = 16384;
+  size_t capacity = (size_hint > 0) ? size_hint + 1 : kBlockSize;
+  size_t size = 0;
+  uint8_t* buffer = (uint8_t*)malloc(capacity);
+  if (buffer == NULL) return 0;
+
+  for (;;) {
+    ssize_t n;
+    if (size == capacity) {
+      uint8_t* const new_buffer = (uint8_t*)realloc(buffer, 2 * capacity);
+      if (new_buffer == NULL) goto Error;
+      buffer = new_buffer;
+      capacity *= 2;
+    }
+    n = read(fd, buffer + size, capacity - size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      goto Error;
+    }
+    if (n == 0) break;
+    size += (size_t)n;
+  }
+  view->data = buffer;
+  view->size = size;
+  return 1;
+
+ Error:
+  free(buffer);
+  return 0;
+}
+
+static int OpenFdView(int fd, ImgIoUtilFileView* const view) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) return 0;
+
+  if (S_ISREG(st.st_mode)) {
+    void* mapping;
+    if ((uint64_t)st.st_size > (uint64_t)SIZE_MAX) return 0;
+    if (st.st_size == 0) {
+      view->data = kEmptyFile;
+      view->size = 0;
+      return 1;
+    }
+    mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      // the readers go through the file front to back, so the kernel can read
+      // ahead aggressively and drop the pages behind
+      posix_madvise(mapping, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+      view->mapping = mapping;
+      view->data = (const uint8_t*)mapping;
+      view->size = (size_t)st.st_size;
+      return 1;
+    }
+    return ReadFdToView(fd, (size_t)st.st_size, view);
+  }
+  return ReadFdToView(fd, 0, view);
+}
+
+int ImgIoUtilOpenFileView(const char* const file_name,
+                          ImgIoUtilFileView* const view) {
+  int fd;
+  int ok;
+  if (view == NULL) return 0;
+  memset(view, 0, sizeof(*view));
+
+  if (IsStdin(file_name)) {
+    // a redirected file is mapped unless something already consumed part of it
+    ok = (lseek(STDIN_FILENO, 0, SEEK_CUR) == 0) ? OpenFdView(STDIN_FILENO, view)
+                                                 : ReadFdToView(STDIN_FILENO, 0, view);
+    if (!ok) fprintf(stderr, "Could not read from stdin\n");
+    return ok;
+  }
+
+  fd = open(file_name, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "cannot open input file '%s'\n", file_name);
+    return 0;
+  }
+  ok = OpenFdView(fd, view);
+  close(fd);    // a mapping stays valid after its descriptor is closed
+  if (!ok) fprintf(stderr, "Could not read file %s\n", file_name);
+  return ok;
+}
+
+void ImgIoUtilCloseFileView(ImgIoUtilFileView* const view) {
+  if (view == NULL) return;
+  if (view->mapping != NULL) {
+    munmap(view->mapping, view->size);
+  } else if (view->data != kEmptyFile) {
+    free((void*)view->data);
+  }
+  memset(view, 0, sizeof(*view));
+}
+
+#else  // _WIN32
+
+int ImgIoUtilOpenFileView(const char* const file_name,
+                          ImgIoUtilFileView* const view) {
+  HANDLE file;
+  LARGE_INTEGER file_size;
+  if (view == NULL) return 0;
+  memset(view, 0, sizeof(*view));
+
+  if (IsStdin(file_name)) {
+    return ImgIoUtilReadFromStdin(&view->data, &view->size);
+  }
+
+  file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, NULL,
+                     OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    fprintf(stderr, "cannot open input file '%s'\n", file_name);
+    return 0;
+  }
+
+  if (GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &file_size) &&
+      (uint64_t)file_size.QuadPart <= (uint64_t)SIZE_MAX) {
+    if (file_size.QuadPart == 0) {
+      CloseHandle(file);
+      view->data = kEmptyFile;
+      view->size = 0;
+      return 1;
+    }
+    view->map_handle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (view->map_handle != NULL) {
+      view->mapping = MapViewOfFile((HANDLE)view->map_handle, FILE_MAP_READ,
+                                    0, 0, 0);
+      if (view->mapping != NULL) {
+        CloseHandle(file);    // the mapping object keeps the file open
+        view->data = (const uint8_t*)view->mapping;
+        view->size = (size_t)file_size.QuadPart;
+        return 1;
+      }
+      CloseHandle((HANDLE)view->map_handle);
+      view->map_handle = NULL;
+    }
+  }
+  CloseHandle(file);
+
+  // not mappable, e.g. a named pipe: read it like stdin
+  {
+    FILE* const in = fopen(file_name, "rb");
+    int ok;
+    if (in == NULL) {
+      fprintf(stderr, "cannot open input file '%s'\n", file_name);
+      return 0;
+    }
+    ok = ReadFromStream(in, &view->data, &view->size);
+    fclose(in);
+    if (!ok) fprintf(stderr, "Could not read file %s\n", file_name);
+    return ok;
+  }
+}
+
+void ImgIoUtilCloseFileView(ImgIoUtilFileView* const view) {
+  if (view == NULL) return;
+  if (view->mapping != NULL) {
+    UnmapViewOfFile(view->mapping);
+    CloseHandle((HANDLE)view->map_handle);
+  } else if (view->data != kEmptyFile) {
+    free((void*)view->data);
+  }
+  memset(view, 0, sizeof(*view));
+}
+
+#endif  // _WIN32
+
+// The caller owns the returned buffer, so a mapped view is copied out. Callers
+// that only read the data should use ImgIoUtilOpenFileView() directly.
 int ImgIoUtilReadFile(const TCHAR*  file_name,
                       const uint8_t** data, size_t* data_size) {
-  int ok;
+  ImgIoUtilFileView view;
   void* file_data;
   size_t file_size;
-  FILE* in;
-  
-  const int from_stdin = 0;
-
-  //const int from_stdin = (file_name == NULL) || !strcmp(file_name, "-");
-
-  if (from_stdin) return ImgIoUtilReadFromStdin(data, data_size);
 
   if (data == NULL || data_size == NULL) return 0;
   *data = NULL;
   *data_size = 0;
 
-  in = _tfopen(file_name, _T("rb+"));
-  if (in == NULL) {
-    fprintf(stderr, "cannot open input file '%s'\n", file_name);
-    return 0;
-  }
-  fseek(in, 0, SEEK_END);
-  file_size = ftell(in);
-  fseek(in, 0, SEEK_SET);
-  file_data = malloc(file_size);
-  if (file_data == NULL) return 0;
-  ok = (fread(file_data, file_size, 1, in) == 1);
-  fclose(in);
-
-  if (!ok) {
-    fprintf(stderr, "Could not read %d bytes of data from file %s\n",
-            (int)file_size, file_name);
-    free(file_data);
-    return 0;
+  if (!ImgIoUtilOpenFileView(file_name, &view)) return 0;
+  file_size = view.size;
+
+  if (view.mapping == NULL && view.data != kEmptyFile) {
+    file_data = (void*)view.data;    // already a malloc'd copy, hand it over
+  } else {
+    file_data = malloc(file_size > 0 ? file_size : 1);
+    if (file_data == NULL) {
+      ImgIoUtilCloseFileView(&view);
+      return 0;
+    }
+    memcpy(file_data, view.data, file_size);
+    ImgIoUtilCloseFileView(&view);
   }
   *data = (uint8_t*)file_data;
   *data_size = file_size;
@@ -24,9 +24,9 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "encode.h"
-#include "imageio_util.h"
-#include "metadata.h"
+#include "webp/encode.h"
+#include "imageio/imageio_util.h"
+#include "imageio/metadata.h"
 
 // -----------------------------------------------------------------------------
 // Metadata processing
@@ -23,9 +23,9 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "encode.h"
-#include "imageio_util.h"
-#include "metadata.h"
+#include "webp/encode.h"
+#include "imageio/imageio_util.h"
+#include "imageio/metadata.h"
 
 static void PNGAPI error_function(png_structp png, png_const_charp error) {
   if (error != NULL) fprintf(stderr, "libpng error: %s\n", error);
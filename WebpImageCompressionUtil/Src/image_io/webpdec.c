@@ -20,6 +20,7 @@
 #include "webp/encode.h"
 #include "imageio/imageio_util.h"
 #include "imageio/metadata.h"
+#include "WebPPixelKernels.h"
 
 //------------------------------------------------------------------------------
 // WebP decoding
@@ -179,10 +180,11 @@ int ReadWebP(const uint8_t* const data, size_t data_size,
     if (!ok) WebPPictureFree(pic);
     if (ok && !keep_alpha && pic->use_argb) {
       // Need to wipe out the alpha value, as requested.
-      int x, y;
+      const WebpPixelKernels* const kernels = WebpGetPixelKernels();
+      int y;
       uint32_t* argb = pic->argb;
       for (y = 0; y < pic->height; ++y) {
-        for (x = 0; x < pic->width; ++x) argb[x] |= 0xff000000u;
+        kernels->ptr_fill_alpha(argb, pic->width);
         argb += pic->argb_stride;
       }
     }
@@ -86,15 +86,14 @@ WEBP_DEFINE_GUID(GUID_WICPixelFormat64bppRGBA_,
 static HRESULT OpenInputStream(const char* filename, IStream** stream) {
   HRESULT hr = S_OK;
   if (!strcmp(filename, "-")) {
-    const uint8_t* data = NULL;
-    size_t data_size = 0;
-    const int ok = ImgIoUtilReadFile(filename, &data, &data_size);
+    ImgIoUtilFileView view;
+    const int ok = ImgIoUtilOpenFileView(filename, &view);
     if (ok) {
-      HGLOBAL image = GlobalAlloc(GMEM_MOVEABLE, data_size);
+      HGLOBAL image = GlobalAlloc(GMEM_MOVEABLE, view.size);
       if (image != NULL) {
         void* const image_mem = GlobalLock(image);
         if (image_mem != NULL) {
-          memcpy(image_mem, data, data_size);
+          memcpy(image_mem, view.data, view.size);
           GlobalUnlock(image);
           IFS(CreateStreamOnHGlobal(image, TRUE, stream));
         } else {
@@ -103,10 +102,10 @@ static HRESULT OpenInputStream(const char* filename, IStream** stream) {
       } else {
         hr = E_OUTOFMEMORY;
       }
-      free((void*)data);
     } else {
       hr = E_FAIL;
     }
+    ImgIoUtilCloseFileView(&view);
   } else {
     IFS(SHCreateStreamOnFileA(filename, STGM_READ, stream));
   }
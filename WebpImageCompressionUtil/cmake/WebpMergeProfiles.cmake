@@ -0,0 +1,17 @@
+# Merges the raw Clang profiles of a training run into the single file -fprofile-use reads.
+#
+#   cmake -DLLVM_PROFDATA=<tool> -DPROFILE_DIR=<dir> -DOUTPUT=<file> -P WebpMergeProfiles.cmake
+
+file(GLOB WEBP_RAW_PROFILES "${PROFILE_DIR}/*.profraw")
+
+if(NOT WEBP_RAW_PROFILES)
+  message(FATAL_ERROR "No .profraw files in ${PROFILE_DIR}, did the training run use the instrumented build?")
+endif()
+
+execute_process(COMMAND "${LLVM_PROFDATA}" merge -output=${OUTPUT} ${WEBP_RAW_PROFILES} RESULT_VARIABLE WEBP_MERGE_RESULT)
+
+if(NOT WEBP_MERGE_RESULT EQUAL 0)
+  message(FATAL_ERROR "llvm-profdata merge failed (${WEBP_MERGE_RESULT})")
+endif()
+
+file(REMOVE ${WEBP_RAW_PROFILES})
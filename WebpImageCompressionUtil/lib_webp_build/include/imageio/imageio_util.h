@@ -38,6 +38,27 @@ int ImgIoUtilReadFile(const char* const file_name,
 // Same as ImgIoUtilReadFile(), but reads until EOF from stdin instead.
 int ImgIoUtilReadFromStdin(const uint8_t** data, size_t* data_size);
 
+// Read-only view of a whole file. Regular files are memory mapped, so nothing
+// is copied and the pages are shared through the page cache with every other
+// process reading the same file. Pipes, character devices and files that
+// can't be mapped are read into a malloc'd buffer instead. 'data' and 'size'
+// are the only fields meant for the caller.
+typedef struct {
+  const uint8_t* data;
+  size_t size;
+  void* mapping;      // base of the mapping, NULL when 'data' was malloc'd
+  void* map_handle;   // Windows file mapping object
+} ImgIoUtilFileView;
+
+// Opens 'file_name' as a view, or stdin if it is NULL or "-" (stdin is mapped
+// too when it is redirected from a regular file). Returns 1 on success, 0
+// otherwise. The view must be released with ImgIoUtilCloseFileView(), even
+// after a failure.
+int ImgIoUtilOpenFileView(const char* const file_name,
+                          ImgIoUtilFileView* const view);
+
+void ImgIoUtilCloseFileView(ImgIoUtilFileView* const view);
+
 // Write a data segment into a file named 'file_name'. Returns true if ok.
 // If 'file_name' is NULL or equal to "-", output is written to stdout.
 int ImgIoUtilWriteFile(const char* const file_name,